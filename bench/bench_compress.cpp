@@ -0,0 +1,189 @@
+/*
+ * bench_compress.cpp -- micro-benchmark for sorting and merging the
+ * 	(address, value) pairs of transactions (tx_compress.h), compared to
+ * 	using std::sort for all transactions (as txedge did before)
+ *
+ * transactions are read from a txin or txout file (TSV, sorted by txid, as
+ * used by txedge), so the real distribution of transaction sizes is used;
+ * all transactions are compressed with both methods reps times, timings are
+ * reported in total and separately by the size ranges where tx_compress()
+ * uses different methods; results are checked to be the same
+ *
+ * compile:
+ * g++ -o bench_compress bench_compress.cpp -std=gnu++17 -O3 -march=native
+ *
+ * usage:
+ * bench_compress [-i txin.dat | -o txout.dat] [-r reps]
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "../read_table.h"
+#include "../tx_compress.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+
+/* previous version: std::sort for all sizes */
+static void compress_sort(std::vector<tx_addr_value>& vec) {
+	std::sort(vec.begin(),vec.end(),[](const auto& a, const auto& b) { return a.first < b.first; });
+	size_t i=0;
+	for(size_t j=1;j<vec.size();j++) {
+		if(vec[i].first == vec[j].first) vec[i].second += vec[j].second;
+		else {
+			i++;
+			if(i != j) vec[i] = vec[j];
+		}
+	}
+	if(!vec.empty()) vec.erase(vec.begin()+i+1,vec.end());
+}
+
+/* size ranges reported separately */
+static const unsigned int nclasses = 4;
+static const char* const class_names[nclasses] = {"1-2","3-16","17-64",">64"};
+static unsigned int size_class(size_t n) {
+	if(n <= 2) return 0;
+	if(n <= tx_compress_small) return 1;
+	if(n <= tx_compress_large) return 2;
+	return 3;
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* fn = 0;
+	bool txout = false;
+	unsigned int reps = 5;
+
+	for(int i=1;i<argc;i++) {
+		if(argv[i][0] == '-') switch(argv[i][1]) {
+			case 'i':
+			case 'o':
+				if(i+1 >= argc) break;
+				fn = argv[i+1];
+				txout = (argv[i][1] == 'o');
+				i++;
+				break;
+			case 'r':
+				if(i+1 >= argc) break;
+				reps = atoi(argv[i+1]);
+				i++;
+				break;
+			default:
+				fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+				break;
+		}
+		else fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+	}
+	if(!fn || !reps) {
+		fprintf(stderr,"Usage: %s [-i txin.dat | -o txout.dat] [-r reps]\n",argv[0]);
+		return 1;
+	}
+
+	/* read all records: txin has txid, input seq, prev txid, prev output
+	 * seq, address, value; txout has txid, output seq, address, value */
+	std::vector<tx_addr_value> recs;
+	std::vector<size_t> starts; // start of each transaction in recs
+	{
+		read_table2 rt(fn);
+		uint32_t txid = 0;
+		while(rt.read_line()) {
+			uint32_t txid1;
+			int32_t addr;
+			int64_t value;
+			if(!rt.read_uint32(txid1)) break;
+			if(!rt.read_skip()) break;
+			if(!txout && !(rt.read_skip() && rt.read_skip())) break;
+			if(!(rt.read_int32(addr) && rt.read_int64(value))) break;
+			if(starts.empty() || txid1 != txid) starts.push_back(recs.size());
+			txid = txid1;
+			recs.push_back(std::make_pair(addr,value));
+		}
+		if(rt.get_last_error() != T_EOF) {
+			fprintf(stderr,"Error reading input:\n");
+			rt.write_error(stderr);
+			return 1;
+		}
+	}
+	size_t ntx = starts.size();
+	starts.push_back(recs.size());
+
+	std::vector<size_t> txs[nclasses]; // transactions in each size class
+	uint64_t pairs[nclasses] = {0,0,0,0};
+	for(size_t i=0;i<ntx;i++) {
+		size_t n = starts[i+1] - starts[i];
+		txs[size_class(n)].push_back(i);
+		pairs[size_class(n)] += n;
+	}
+	fprintf(stderr,"%zu transactions, %zu records\n",ntx,recs.size());
+
+	/* time both methods; transactions are copied to the same vector (as
+	 * done in txedge), cost of copying is included for both */
+	typedef std::chrono::steady_clock clk;
+	double t_sort[nclasses] = {0,0,0,0};
+	double t_new[nclasses] = {0,0,0,0};
+	std::vector<tx_addr_value> v1, v2, tmp;
+	uint64_t check1 = 0, check2 = 0;
+	for(unsigned int r=0;r<reps;r++) for(unsigned int m=0;m<2;m++) {
+		/* process size classes separately, so timer overhead is not
+		 * included for each transaction (order of transactions is kept
+		 * within each class) */
+		for(unsigned int c=0;c<nclasses;c++) {
+			auto t0 = clk::now();
+			for(size_t i : txs[c]) {
+				std::vector<tx_addr_value>& v = m ? v2 : v1;
+				v.assign(recs.begin() + starts[i],recs.begin() + starts[i+1]);
+				if(m) tx_compress(v,tmp);
+				else compress_sort(v);
+				/* use the result, so nothing is optimized out */
+				uint64_t x = v.size();
+				for(const auto& y : v) x = x*31 + (uint32_t)y.first + (uint64_t)y.second;
+				if(m) check2 += x;
+				else check1 += x;
+			}
+			std::chrono::duration<double> d = clk::now() - t0;
+			if(m) t_new[c] += d.count();
+			else t_sort[c] += d.count();
+		}
+	}
+	if(check1 != check2) {
+		fprintf(stderr,"Error: results differ!\n");
+		return 1;
+	}
+
+	double s1 = 0.0, s2 = 0.0;
+	printf("size\ttxs\tpairs\tstd::sort (ms)\ttx_compress (ms)\tspeedup\n");
+	for(unsigned int c=0;c<nclasses;c++) {
+		double x1 = 1000.0 * t_sort[c] / reps;
+		double x2 = 1000.0 * t_new[c] / reps;
+		s1 += x1;
+		s2 += x2;
+		printf("%s\t%lu\t%lu\t%.3f\t%.3f\t%.2f\n",class_names[c],(unsigned long)txs[c].size(),
+			(unsigned long)pairs[c],x1,x2,x2 > 0.0 ? x1/x2 : 0.0);
+	}
+	printf("total\t%zu\t%zu\t%.3f\t%.3f\t%.2f\n",ntx,recs.size(),s1,s2,s2 > 0.0 ? s1/s2 : 0.0);
+
+	return 0;
+}
+
@@ -0,0 +1,317 @@
+/*
+ * bench_stages.cpp -- benchmarks of the stages of processing in txedge,
+ * 	using real or generated (see txgen.cpp) txin and txout files
+ *
+ * stages measured (each is run reps times, the fastest run is reported):
+ * 	read_table: parsing the columns used from both files with read_table2
+ * 	txr_it: reading the records of both files with txr_it (as txedge
+ * 		does in sequential mode)
+ * 	tx::read_next: joining inputs and outputs into transactions, sorting
+ * 		and merging them (from records already in memory)
+ * 	tx::iterator, tx::get_edges: creating the edges of each transaction
+ * 		(note that the iterator is only used to sum the weights here,
+ * 		while get_edges() stores all edges in memory, so the latter
+ * 		is expected to be slower; its use is in writing whole batches)
+ * 	write (TSV, shortest TSV, binary): formatting the edges (into memory)
+ * the times for the last three are the extra time compared to
+ * tx::read_next, i.e. the time of the given stage only; finally, an
+ * end-to-end run (the same as txedge without any options except the output
+ * format, writing to /dev/null) is timed, reporting records/s and edges/s
+ *
+ * compile (from the bench directory):
+ * g++ -o bench_stages bench_stages.cpp -std=gnu++17 -O3 -march=native -llzma -lz -lpthread
+ *
+ * usage:
+ * bench_stages -i txin.dat -o txout.dat [-r reps] [-f t|s|b] [-j]
+ * 	-f: output format for the end-to-end run (TSV, shortest TSV or binary)
+ * 	-j: end-to-end run in pipelined mode (as txedge -j 2)
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#define TXEDGE_NO_MAIN
+#include "../txedge.cpp"
+#include <chrono>
+#include <sys/stat.h>
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double bench_elapsed(bench_clock::time_point t0) {
+	std::chrono::duration<double> d = bench_clock::now() - t0;
+	return d.count();
+}
+
+/* result of one stage */
+struct bench_result {
+	double t; // time in seconds
+	uint64_t recs; // records read
+	uint64_t txs; // transactions processed
+	uint64_t edges; // edges created
+	uint64_t bytes; // bytes read or written
+	uint64_t check; // checksum of results, so that nothing is optimized out
+};
+
+static void bench_print_header() {
+	printf("stage\ttime (s)\trecords/s\ttxs/s\tedges/s\tMB/s\n");
+}
+
+static void bench_print(const char* name, const bench_result& r) {
+	auto rate = [&r](uint64_t x) { return (r.t > 0.0 && x) ? x / r.t : 0.0; };
+	printf("%s\t%.3f\t%.4g\t%.4g\t%.4g\t%.1f\n",name,r.t,rate(r.recs),rate(r.txs),
+		rate(r.edges),rate(r.bytes) / 1e6);
+}
+
+/* run f reps times, return the fastest run */
+template<class F>
+static bench_result bench_run(unsigned int reps, F f) {
+	bench_result best;
+	for(unsigned int i=0;i<reps;i++) {
+		bench_result r = {0.0,0,0,0,0,0};
+		auto t0 = bench_clock::now();
+		f(r);
+		r.t = bench_elapsed(t0);
+		if(i == 0 || r.t < best.t) best = r;
+	}
+	return best;
+}
+
+static uint64_t bench_file_size(const char* fn) {
+	struct stat st;
+	if(stat(fn,&st)) return 0;
+	return st.st_size;
+}
+
+/* parse the columns given by cols of one file with read_table2 */
+static void bench_read_table(const char* fn, const txr_cols& cols, bench_result& r) {
+	txinput in;
+	if(!in.open(fn,false,false,1)) throw new std::runtime_error("bench_read_table: cannot open input file!\n");
+	read_table2 rt(in.f);
+	if(!txinput_setup(rt,in,fn)) throw new std::runtime_error("bench_read_table: error allocating memory!\n");
+	unsigned int ncols = std::max(cols.txid,std::max(cols.addr,cols.value)) + 1;
+	while(rt.read_line()) {
+		uint32_t txid = 0;
+		int32_t addr = 0;
+		int64_t value = 0;
+		for(unsigned int i=0;i<ncols;i++) {
+			bool ret;
+			if(i == cols.txid) ret = rt.read_uint32(txid);
+			else if(i == cols.addr) ret = rt.read_int32_limits(addr,-1,INT32_MAX);
+			else if(i == cols.value) ret = rt.read_int64(value);
+			else ret = rt.read_skip();
+			if(!ret) break;
+		}
+		r.recs++;
+		r.check += txid + addr + value;
+	}
+	if(rt.get_last_error() != T_EOF) {
+		rt.write_error(stderr);
+		throw new std::runtime_error("bench_read_table: invalid data!\n");
+	}
+	r.bytes += bench_file_size(fn);
+}
+
+/* read all records of one file with txr_it, optionally storing them */
+static void bench_txr_it(const char* fn, const txr_cols& cols, bench_result& r,
+		std::vector<txrecord>* recs = 0) {
+	txinput in;
+	if(!in.open(fn,false,false,1)) throw new std::runtime_error("bench_txr_it: cannot open input file!\n");
+	txr_it it(in,cols,fn);
+	for(;!it.is_end();++it) {
+		r.recs++;
+		r.check += it->txid + it->addr + it->value;
+		if(recs) recs->push_back(*it);
+	}
+	r.bytes += bench_file_size(fn);
+}
+
+/* what is done with each transaction in bench_tx() */
+enum bench_tx_mode { bench_tx_read, bench_tx_iterator, bench_tx_edges, bench_tx_write };
+
+/* process transactions from the records in memory */
+static void bench_tx(const std::vector<txrecord>& in, const std::vector<txrecord>& out,
+		bench_tx_mode mode, out_format fmt, bench_result& r) {
+	txr_vec_it in_it(in);
+	txr_vec_it out_it(out);
+	tx_t<txr_vec_it> t(in_it,out_it);
+	tx_batch b;
+	mem_buf o;
+	r.recs = in.size() + out.size();
+	while(t.read_next()) {
+		r.txs++;
+		r.check += t.get_inputs().size() + t.get_outputs().size();
+		switch(mode) {
+			case bench_tx_read:
+				break;
+			case bench_tx_iterator:
+				for(auto it = t.get_iterator();!it.is_end();++it) {
+					r.edges++;
+					r.check += (uint64_t)it->w;
+				}
+				break;
+			case bench_tx_edges:
+				b.clear();
+				r.edges += t.get_edges(b);
+				if(b.size()) r.check += (uint64_t)b.w[0];
+				break;
+			case bench_tx_write:
+				r.edges += write_tx_edges(t,o,fmt,b);
+				if(o.len > (1U << 20)) {
+					r.bytes += o.len;
+					o.clear();
+				}
+				break;
+		}
+	}
+	r.bytes += o.len;
+}
+
+/* the same as the main loop of txedge in sequential or pipelined mode,
+ * writing to /dev/null */
+static void bench_end_to_end(const char* txin, const char* txout, out_format fmt, bool pipelined, bench_result& r) {
+	int fd = open("/dev/null",O_WRONLY);
+	if(fd < 0) throw new std::runtime_error("bench_end_to_end: cannot open /dev/null!\n");
+	{
+		txinput in;
+		txinput out;
+		if(!(in.open(txin,false,false,1) && out.open(txout,false,false,1)))
+			throw new std::runtime_error("bench_end_to_end: cannot open input files!\n");
+		txr_it in_it(in,txin_cols,txin);
+		txr_it out_it(out,txout_cols,txout);
+		if(pipelined) {
+			in_it.start_thread();
+			out_it.start_thread();
+		}
+		buf_writer w(fd,1U << 22,pipelined);
+		edge_writer ew(fmt);
+		tx tx_it(in_it,out_it);
+		while(tx_it.read_next()) ew.add(tx_it,w);
+		w.close();
+		r.txs = ew.txs;
+		r.edges = ew.edges;
+	}
+	close(fd);
+	r.recs = 0;
+	r.bytes = bench_file_size(txin) + bench_file_size(txout);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* txin = 0;
+	const char* txout = 0;
+	unsigned int reps = 3;
+	out_format fmt = out_tsv;
+	bool pipelined = false;
+
+	for(int i=1;i<argc;i++) {
+		if(argv[i][0] == '-') switch(argv[i][1]) {
+			case 'i':
+				if(i+1 < argc) txin = argv[++i];
+				break;
+			case 'o':
+				if(i+1 < argc) txout = argv[++i];
+				break;
+			case 'r':
+				if(i+1 < argc) reps = atoi(argv[++i]);
+				break;
+			case 'f':
+				if(i+1 < argc) {
+					i++;
+					if(argv[i][0] == 's') fmt = out_tsv_short;
+					else if(argv[i][0] == 'b') fmt = out_bin;
+					else fmt = out_tsv;
+				}
+				break;
+			case 'j':
+				pipelined = true;
+				break;
+			default:
+				fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+				break;
+		}
+		else fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+	}
+	if(!txin || !txout || !reps) {
+		fprintf(stderr,"Usage: %s -i txin.dat -o txout.dat [-r reps] [-f t|s|b] [-j]\n",argv[0]);
+		return 1;
+	}
+
+	bench_print_header();
+	bench_result r = bench_run(reps,[txin,txout](bench_result& r) {
+		bench_read_table(txin,txin_cols,r);
+		bench_read_table(txout,txout_cols,r);
+	});
+	bench_print("read_table",r);
+	r = bench_run(reps,[txin,txout](bench_result& r) {
+		bench_txr_it(txin,txin_cols,r);
+		bench_txr_it(txout,txout_cols,r);
+	});
+	bench_print("txr_it",r);
+
+	std::vector<txrecord> in, out;
+	{
+		bench_result tmp = {0.0,0,0,0,0,0};
+		bench_txr_it(txin,txin_cols,tmp,&in);
+		bench_txr_it(txout,txout_cols,tmp,&out);
+	}
+	/* note: warnings about transactions without outputs are written
+	 * once for each run */
+	bench_result base = bench_run(reps,[&in,&out](bench_result& r) {
+		bench_tx(in,out,bench_tx_read,out_tsv,r);
+	});
+	bench_print("tx::read_next",base);
+
+	auto extra = [&base](bench_result r) {
+		r.t = std::max(0.0,r.t - base.t);
+		r.recs = 0;
+		r.txs = 0;
+		return r;
+	};
+	r = bench_run(reps,[&in,&out](bench_result& r) {
+		bench_tx(in,out,bench_tx_iterator,out_tsv,r);
+	});
+	bench_print("tx::iterator",extra(r));
+	r = bench_run(reps,[&in,&out](bench_result& r) {
+		bench_tx(in,out,bench_tx_edges,out_tsv,r);
+	});
+	bench_result edges = extra(r);
+	bench_print("tx::get_edges",edges);
+
+	const out_format fmts[3] = {out_tsv,out_tsv_short,out_bin};
+	const char* const fmt_names[3] = {"write (TSV)","write (shortest TSV)","write (binary)"};
+	for(unsigned int i=0;i<3;i++) {
+		r = bench_run(reps,[&in,&out,&fmts,i](bench_result& r) {
+			bench_tx(in,out,bench_tx_write,fmts[i],r);
+		});
+		r = extra(r);
+		r.t = std::max(0.0,r.t - edges.t);
+		bench_print(fmt_names[i],r);
+	}
+
+	r = bench_run(reps,[txin,txout,fmt,pipelined](bench_result& r) {
+		bench_end_to_end(txin,txout,fmt,pipelined,r);
+	});
+	r.recs = in.size() + out.size();
+	bench_print("end-to-end",r);
+
+	return 0;
+}
+
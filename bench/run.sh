@@ -0,0 +1,30 @@
+####################################################################
+# script to run the benchmarks on generated data
+# (run from the bench directory; the first argument is the number of
+# transactions to generate, default is 10 million)
+
+NTX=${1:-10000000}
+
+# 1. compile the generator and the benchmarks
+g++ -o txgen txgen.cpp -std=gnu++17 -O3 -march=native -lpthread
+g++ -o bench_compress bench_compress.cpp -std=gnu++17 -O3 -march=native
+g++ -o bench_stages bench_stages.cpp -std=gnu++17 -O3 -march=native -llzma -lz -lpthread
+g++ -o ../txedge ../txedge.cpp -std=gnu++17 -O3 -march=native -llzma -lz -lpthread
+
+# 2. generate the data (the same data for the same number of transactions and seed)
+./txgen -i txin_gen.dat -o txout_gen.dat -n $NTX -s 1
+
+# 3. run the benchmarks
+./bench_compress -i txin_gen.dat
+./bench_compress -o txout_gen.dat
+./bench_stages -i txin_gen.dat -o txout_gen.dat
+./bench_stages -i txin_gen.dat -o txout_gen.dat -j
+
+# 4. end-to-end runs of txedge in different modes
+time ../txedge -i txin_gen.dat -o txout_gen.dat > /dev/null
+time ../txedge -i txin_gen.dat -o txout_gen.dat -j 2 > /dev/null
+time ../txedge -i txin_gen.dat -o txout_gen.dat -w 4 > /dev/null
+time ../txedge -i txin_gen.dat -o txout_gen.dat -b > /dev/null
+
+rm txin_gen.dat txout_gen.dat
+
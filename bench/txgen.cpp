@@ -0,0 +1,263 @@
+/*
+ * txgen.cpp -- generate synthetic transaction inputs and outputs files in
+ * 	the format used by txedge (txin.dat and txout.dat), for benchmarking
+ * 	without the real dataset
+ *
+ * transactions are generated in order of txid; similarly to the real data:
+ * 	the first transaction of each block (of -B transactions) is a mining
+ * 		transaction (no inputs, one output of 50 BTC to a new address)
+ * 	other transactions spend randomly selected unspent outputs (so inputs
+ * 		refer to actual earlier outputs, and an address can appear more
+ * 		than once among the inputs)
+ * 	the number of inputs and outputs follows a heavy-tailed distribution:
+ * 		most transactions have 1 input and 1 or 2 outputs, while the
+ * 		probability of larger numbers decays as a power law (capped by -m)
+ * 	output addresses: the unknown address (-1) with probability -u; a
+ * 		change output to one of the input addresses (with probability 0.3
+ * 		for the last output of transactions with more than one output); an
+ * 		address of a randomly selected earlier output with probability
+ * 		-a (i.e. preferential reuse of popular addresses); a new address
+ * 		otherwise
+ * 	the sum of outputs is the sum of inputs minus a small fee, split
+ * 		randomly between the outputs
+ * the output is the same for the same parameters and seed
+ *
+ * output formats:
+ * 	txin: txID, input_seq, prev_txID, prev_output_seq, addrID, sum
+ * 	txout: txID, output_seq, addrID, sum
+ *
+ * compile:
+ * g++ -o txgen txgen.cpp -std=gnu++17 -O3 -march=native -lpthread
+ *
+ * usage:
+ * txgen -i txin.dat -o txout.dat [-n ntx] [-s seed] [-m max] [-B block]
+ * 	[-u p_unknown] [-a p_reuse]
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "../buf_writer.h"
+#include "../format_num.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+
+/* random numbers that only depend on the seed (std::mt19937_64 is fully
+ * specified, distributions in the standard library are not) */
+class txgen_rng {
+	protected:
+		std::mt19937_64 g;
+	public:
+		explicit txgen_rng(uint64_t seed) : g(seed) { }
+		/* uniform in [0,1) */
+		double uniform() { return (g() >> 11) * 0x1.0p-53; }
+		/* uniform integer in [0,n) */
+		uint64_t below(uint64_t n) { return (uint64_t)(uniform() * n); }
+		/* power law: P(k) ~ k^-alpha for k >= 1 (approximately), at most max */
+		uint64_t powerlaw(double alpha, uint64_t max) {
+			double x = pow(1.0 - uniform(),-1.0 / (alpha - 1.0));
+			if(x >= (double)max) return max;
+			return (uint64_t)x;
+		}
+};
+
+/* one unspent output */
+struct txgen_utxo {
+	uint32_t txid;
+	uint32_t seq;
+	int32_t addr;
+	int64_t value;
+};
+
+
+int main(int argc, char** argv)
+{
+	const char* txin_fn = 0;
+	const char* txout_fn = 0;
+	uint64_t ntx = 1000000;
+	uint64_t seed = 1;
+	uint64_t max_n = 10000; // maximum number of inputs or outputs
+	uint64_t block = 500; // transactions per block (one mining transaction each)
+	double p_unknown = 0.005;
+	double p_reuse = 0.4;
+
+	for(int i=1;i<argc;i++) {
+		if(argv[i][0] == '-' && i+1 < argc) switch(argv[i][1]) {
+			case 'i':
+				txin_fn = argv[++i];
+				break;
+			case 'o':
+				txout_fn = argv[++i];
+				break;
+			case 'n':
+				ntx = strtoull(argv[++i],0,10);
+				break;
+			case 's':
+				seed = strtoull(argv[++i],0,10);
+				break;
+			case 'm':
+				max_n = strtoull(argv[++i],0,10);
+				break;
+			case 'B':
+				block = strtoull(argv[++i],0,10);
+				break;
+			case 'u':
+				p_unknown = atof(argv[++i]);
+				break;
+			case 'a':
+				p_reuse = atof(argv[++i]);
+				break;
+			default:
+				fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+				break;
+		}
+		else fprintf(stderr,"Unknown parameter: %s!\n",argv[i]);
+	}
+	if(!txin_fn || !txout_fn || !ntx || !max_n || !block || ntx > UINT32_MAX) {
+		fprintf(stderr,"Usage: %s -i txin.dat -o txout.dat [-n ntx] [-s seed] [-m max] [-B block] "
+			"[-u p_unknown] [-a p_reuse]\n",argv[0]);
+		return 1;
+	}
+
+	int in_fd = open(txin_fn,O_WRONLY | O_CREAT | O_TRUNC,0644);
+	int out_fd = open(txout_fn,O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if(in_fd < 0 || out_fd < 0) {
+		fprintf(stderr,"Error opening output files!\n");
+		return 1;
+	}
+
+	{
+		buf_writer win(in_fd);
+		buf_writer wout(out_fd);
+		txgen_rng r(seed);
+		std::vector<txgen_utxo> utxo; // unspent outputs
+		std::vector<int32_t> out_addrs; // addresses of all outputs so far (for reuse)
+		std::vector<txgen_utxo> inputs;
+		std::vector<double> split;
+		int32_t naddr = 0;
+		uint64_t nin = 0, nout = 0;
+
+		for(uint64_t t=0;t<ntx;t++) {
+			uint32_t txid = (uint32_t)t;
+			uint64_t n_in = 0;
+			uint64_t n_out = 0;
+			int64_t total = 0;
+			inputs.clear();
+			if(t % block && !utxo.empty()) {
+				/* regular transaction */
+				n_in = 1;
+				if(r.uniform() >= 0.7) n_in = 1 + r.powerlaw(2.2,max_n - 1);
+				n_in = std::min(n_in,(uint64_t)utxo.size());
+				n_out = 2;
+				double x = r.uniform();
+				if(x < 0.2) n_out = 1;
+				else if(x >= 0.85) n_out = 2 + r.powerlaw(2.1,max_n - 2);
+				n_out = std::min(n_out,max_n);
+				for(uint64_t i=0;i<n_in;i++) {
+					size_t j = r.below(utxo.size());
+					inputs.push_back(utxo[j]);
+					total += utxo[j].value;
+					utxo[j] = utxo.back();
+					utxo.pop_back();
+					char* p = win.reserve(96);
+					char* p0 = p;
+					p = format_uint32(p,txid);
+					*p++ = '\t';
+					p = format_uint64(p,i);
+					*p++ = '\t';
+					p = format_uint32(p,inputs.back().txid);
+					*p++ = '\t';
+					p = format_uint32(p,inputs.back().seq);
+					*p++ = '\t';
+					p = format_int32(p,inputs.back().addr);
+					*p++ = '\t';
+					p = format_int64(p,inputs.back().value);
+					*p++ = '\n';
+					win.commit(p - p0);
+				}
+				nin += n_in;
+				total -= std::min((int64_t)10000,total / 100); // fee
+			}
+			else {
+				/* mining transaction */
+				n_out = 1;
+				total = 5000000000L;
+			}
+
+			/* split the total randomly between the outputs */
+			split.resize(n_out);
+			double sum = 0.0;
+			for(uint64_t i=0;i<n_out;i++) {
+				split[i] = -log(1.0 - r.uniform());
+				sum += split[i];
+			}
+			int64_t rem = total;
+			for(uint64_t i=0;i<n_out;i++) {
+				int64_t value = rem;
+				if(i + 1 < n_out) {
+					value = std::min(rem,(int64_t)(total * (split[i] / sum)));
+					rem -= value;
+				}
+				int32_t addr;
+				if(inputs.empty()) addr = naddr++;
+				else if(r.uniform() < p_unknown) addr = -1;
+				else if(n_out > 1 && i + 1 == n_out && r.uniform() < 0.3)
+					addr = inputs[r.below(inputs.size())].addr;
+				else if(!out_addrs.empty() && r.uniform() < p_reuse)
+					addr = out_addrs[r.below(out_addrs.size())];
+				else addr = naddr++;
+				if(addr >= 0) out_addrs.push_back(addr);
+				utxo.push_back(txgen_utxo{txid,(uint32_t)i,addr,value});
+
+				char* p = wout.reserve(96);
+				char* p0 = p;
+				p = format_uint32(p,txid);
+				*p++ = '\t';
+				p = format_uint64(p,i);
+				*p++ = '\t';
+				p = format_int32(p,addr);
+				*p++ = '\t';
+				p = format_int64(p,value);
+				*p++ = '\n';
+				wout.commit(p - p0);
+			}
+			nout += n_out;
+		}
+		win.close();
+		wout.close();
+		if(win.has_error() || wout.has_error()) {
+			fprintf(stderr,"Error writing the output!\n");
+			return 1;
+		}
+		fprintf(stderr,"%lu transactions, %lu inputs, %lu outputs, %ld addresses generated\n",
+			(unsigned long)ntx,(unsigned long)nin,(unsigned long)nout,(long)naddr);
+	}
+	close(in_fd);
+	close(out_fd);
+	return 0;
+}
+
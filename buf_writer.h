@@ -0,0 +1,186 @@
+/*  -*- C++ -*-
+ * buf_writer.h -- buffered output to a file descriptor, optionally
+ * 	performing the actual writes in a separate thread
+ *
+ * example usage:
+
+buf_writer w(STDOUT_FILENO);
+char* p = w.reserve(64); // space for at most 64 bytes
+size_t len = ... // write data to p
+w.commit(len);
+...
+w.flush(); // also done in the destructor
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _BUF_WRITER_H
+#define _BUF_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "spsc_queue.h"
+
+
+/* optional callback called after each write with the time taken (in
+ * nanoseconds) and the number of bytes written (e.g. for statistics) */
+typedef void (*buf_writer_stats_fn)(uint64_t ns, size_t n);
+
+class buf_writer {
+	protected:
+		int fd;
+		std::vector<char> buf; // current buffer
+		size_t len; // data in the current buffer
+		size_t size; // size of buffers
+		std::atomic<bool> error;
+
+		/* writer thread: full buffers are passed in full_q, and empty buffers
+		 * are passed back in free_q to be reused */
+		bool threaded;
+		spsc_queue<std::vector<char> > full_q;
+		spsc_queue<std::vector<char> > free_q;
+		std::thread th;
+		buf_writer_stats_fn stats_fn;
+
+		/* write all data to fd */
+		void write_data(const char* data, size_t n) {
+			std::chrono::steady_clock::time_point t0;
+			if(stats_fn) t0 = std::chrono::steady_clock::now();
+			size_t n0 = n;
+			while(n && !error) {
+				ssize_t ret = ::write(fd,data,n);
+				if(ret < 0) {
+					if(errno == EINTR) continue;
+					fprintf(stderr,"buf_writer: error writing output: %s\n",strerror(errno));
+					error = true;
+					break;
+				}
+				data += ret;
+				n -= ret;
+			}
+			if(stats_fn) stats_fn(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - t0).count(),n0 - n);
+		}
+
+		void writer_thread() {
+			std::vector<char> b;
+			while(full_q.pop(b)) {
+				write_data(b.data(),b.size());
+				b.clear();
+				free_q.push(std::move(b));
+			}
+		}
+
+		/* write out the current buffer, get a new one */
+		void flush_buf() {
+			if(!len) return;
+			if(threaded) {
+				buf.resize(len);
+				std::vector<char> tmp;
+				if(!free_q.try_pop(tmp)) tmp.reserve(size);
+				tmp.resize(size);
+				std::swap(buf,tmp);
+				full_q.push(std::move(tmp));
+			}
+			else write_data(buf.data(),len);
+			len = 0;
+		}
+
+	public:
+		/* fd: file descriptor to write to (not closed by this class)
+		 * size_: size of the buffer(s) used
+		 * threaded_: if true, writes are performed in a separate thread
+		 * stats_fn_: if not null, called after each write (from the writer
+		 * thread if one is used) */
+		explicit buf_writer(int fd_, size_t size_ = (1U << 22), bool threaded_ = false,
+				buf_writer_stats_fn stats_fn_ = 0) :
+				fd(fd_), buf(size_), len(0), size(size_), error(false), threaded(threaded_),
+				full_q(4), free_q(8), stats_fn(stats_fn_) {
+			if(threaded) th = std::thread(&buf_writer::writer_thread,this);
+		}
+		~buf_writer() { close(); }
+
+		/* get space for writing at most n bytes; n should be less than the buffer size */
+		char* reserve(size_t n) {
+			if(len + n > buf.size()) {
+				flush_buf();
+				if(n > buf.size()) buf.resize(n);
+			}
+			return buf.data() + len;
+		}
+		/* n bytes were written after the result of reserve() */
+		void commit(size_t n) { len += n; }
+
+		/* write data */
+		void write(const char* data, size_t n) {
+			char* p = reserve(n);
+			memcpy(p,data,n);
+			commit(n);
+		}
+
+		/* pass all buffered data to be written (if using a separate thread,
+		 * the data may not be written when this function returns) */
+		void flush() { flush_buf(); }
+
+		/* write out all data and stop the writer thread */
+		void close() {
+			flush_buf();
+			if(threaded) {
+				full_q.close();
+				th.join();
+				threaded = false;
+			}
+		}
+
+		/* true if there was an error writing the output */
+		bool has_error() const { return error; }
+};
+
+
+/* in-memory buffer with the same interface (used to collect output that
+ * is written later, e.g. when processing data in parallel) */
+struct mem_buf {
+	std::vector<char> data;
+	size_t len;
+
+	mem_buf() : len(0) { }
+	char* reserve(size_t n) {
+		if(len + n > data.size()) data.resize(std::max(2*data.size(),len + n));
+		return data.data() + len;
+	}
+	void commit(size_t n) { len += n; }
+	void write(const char* p, size_t n) {
+		memcpy(reserve(n),p,n);
+		commit(n);
+	}
+	void clear() { len = 0; }
+};
+
+#endif /* _BUF_WRITER_H */
+
@@ -0,0 +1,116 @@
+/*  -*- C++ -*-
+ * format_num.h -- fast, locale-independent formatting of numbers as text
+ *
+ * all functions write to the given buffer (without a terminating NULL
+ * character) and return a pointer after the last character written;
+ * buffers should have space for at least 24 characters for each number
+ *
+ * floating point values are formatted with std::to_chars() if it is
+ * available (requires C++17 and e.g. gcc >= 11), otherwise with snprintf()
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _FORMAT_NUM_H
+#define _FORMAT_NUM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cmath>
+
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define FORMAT_NUM_TO_CHARS 1
+#endif
+
+
+/* pairs of digits for 00 - 99 */
+static const char format_num_digits2[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* format an unsigned integer */
+static inline char* format_uint64(char* p, uint64_t x) {
+	char tmp[20];
+	char* q = tmp + 20;
+	while(x >= 100) {
+		unsigned int d = (unsigned int)(x % 100) * 2;
+		x /= 100;
+		q -= 2;
+		q[0] = format_num_digits2[d];
+		q[1] = format_num_digits2[d+1];
+	}
+	if(x >= 10) {
+		q -= 2;
+		q[0] = format_num_digits2[2*x];
+		q[1] = format_num_digits2[2*x+1];
+	}
+	else *(--q) = '0' + (char)x;
+	size_t len = tmp + 20 - q;
+	memcpy(p,q,len);
+	return p + len;
+}
+static inline char* format_uint32(char* p, uint32_t x) {
+	return format_uint64(p,x);
+}
+
+/* format a signed integer */
+static inline char* format_int64(char* p, int64_t x) {
+	if(x < 0) {
+		*p = '-';
+		return format_uint64(p+1,0ULL - (uint64_t)x);
+	}
+	return format_uint64(p,(uint64_t)x);
+}
+static inline char* format_int32(char* p, int32_t x) {
+	return format_int64(p,x);
+}
+
+/* format a double value exactly as printf("%.17g") would
+ * (with to_chars or as an integer if the value is integral) */
+static inline char* format_double17(char* p, double x) {
+	/* integers below 10^17 are printed without an exponent or fraction part */
+	if(x == std::trunc(x) && std::fabs(x) < 1e17 && !(x == 0.0 && std::signbit(x)))
+		return format_int64(p,(int64_t)x);
+#ifdef FORMAT_NUM_TO_CHARS
+	return std::to_chars(p,p+32,x,std::chars_format::general,17).ptr;
+#else
+	return p + snprintf(p,32,"%.17g",x);
+#endif
+}
+
+/* format a double value with the shortest representation that is read back
+ * as the same value (this is not the same format as printf(), it can differ
+ * in the number of digits and the use of an exponent); if to_chars is not
+ * available, this is the same as format_double17() */
+static inline char* format_double_short(char* p, double x) {
+#ifdef FORMAT_NUM_TO_CHARS
+	return std::to_chars(p,p+32,x).ptr;
+#else
+	return format_double17(p,x);
+#endif
+}
+
+#endif /* _FORMAT_NUM_H */
+
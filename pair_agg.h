@@ -0,0 +1,258 @@
+/*  -*- C++ -*-
+ * pair_agg.h -- aggregate edges by (addr_in, addr_out) pairs in bounded
+ * 	memory, spilling sorted runs to temporary files if needed
+ *
+ * edges are collected in a buffer; when it is full, it is sorted and
+ * records of the same pair are combined; if the result still takes up more
+ * than half of the buffer, it is written to a temporary file as a sorted
+ * run; at the end, all runs are merged (k-way merge), giving the aggregated
+ * pairs in order of (addr_in, addr_out); the buffer is freed before
+ * merging, so that the buffers used for reading the runs back together
+ * take up the same amount of memory
+ *
+ * for each pair, the total weight, the number of transactions and the first
+ * and last txid is kept; weights of a pair are summed in the order they were
+ * added (and partial sums of runs are added in order), so the result only
+ * depends on the order of adding edges and the memory limit
+ *
+ * example usage:
+
+pair_agg agg(1UL << 30,"/tmp");
+agg.add(addr_in,addr_out,w,txid); // for each edge, in order of txid
+...
+agg.merge([](const pair_agg_rec& r) { ... }); // called for each pair in order
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _PAIR_AGG_H
+#define _PAIR_AGG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <queue>
+#include <algorithm>
+
+
+/* one aggregated pair (or one edge before aggregating) */
+struct pair_agg_rec {
+	int32_t addr_in;
+	int32_t addr_out;
+	uint32_t first_txid;
+	uint32_t last_txid;
+	uint64_t txs; // number of transactions
+	double w; // total weight
+
+	/* order by the pair, then by the first txid (i.e. order of adding) */
+	bool operator < (const pair_agg_rec& r) const {
+		if(addr_in != r.addr_in) return addr_in < r.addr_in;
+		if(addr_out != r.addr_out) return addr_out < r.addr_out;
+		return first_txid < r.first_txid;
+	}
+	bool same_pair(const pair_agg_rec& r) const {
+		return addr_in == r.addr_in && addr_out == r.addr_out;
+	}
+	/* add a record of the same pair that was added later */
+	void combine(const pair_agg_rec& r) {
+		w += r.w;
+		txs += r.txs;
+		last_txid = r.last_txid;
+	}
+};
+
+
+class pair_agg {
+	protected:
+		std::vector<pair_agg_rec> buf;
+		size_t max_recs; // size of buf
+		size_t nsorted; // records at the start of buf that are already sorted and combined
+		std::string tmpdir;
+		std::vector<FILE*> runs; // sorted runs written to temporary files
+		uint64_t spilled; // total number of records written to runs
+		bool error;
+
+		/* sort buf and combine records of the same pair */
+		void compact() {
+			/* note: the sorted part has only pairs from earlier
+			 * transactions, so the ones from it come first */
+			std::sort(buf.begin(),buf.end());
+			size_t j = 0;
+			for(size_t i=1;i<buf.size();i++) {
+				if(buf[j].same_pair(buf[i])) buf[j].combine(buf[i]);
+				else buf[++j] = buf[i];
+			}
+			if(!buf.empty()) buf.resize(j+1);
+			nsorted = buf.size();
+		}
+
+		/* write the contents of buf (already compacted) to a new run */
+		bool spill() {
+			std::string fn = tmpdir + "/txedge_aggXXXXXX";
+			int fd = mkstemp(&fn[0]);
+			if(fd < 0) {
+				fprintf(stderr,"pair_agg: cannot create temporary file in %s!\n",tmpdir.c_str());
+				return false;
+			}
+			unlink(fn.c_str()); // file is removed when closed
+			FILE* f = fdopen(fd,"w+b");
+			if(!f) {
+				close(fd);
+				return false;
+			}
+			runs.push_back(f);
+			if(fwrite(buf.data(),sizeof(pair_agg_rec),buf.size(),f) != buf.size() || fflush(f)) {
+				fprintf(stderr,"pair_agg: error writing temporary file!\n");
+				return false;
+			}
+			spilled += buf.size();
+			buf.clear();
+			nsorted = 0;
+			return true;
+		}
+
+		/* reading back a run in blocks */
+		struct run_reader {
+			FILE* f;
+			std::vector<pair_agg_rec> b;
+			size_t i;
+			size_t n;
+			bool next(pair_agg_rec& r) {
+				if(i == n) {
+					n = fread(b.data(),sizeof(pair_agg_rec),b.size(),f);
+					i = 0;
+					if(n == 0) return false;
+				}
+				r = b[i++];
+				return true;
+			}
+		};
+
+	public:
+		/* mem_limit: memory to use for the buffer in bytes; tmpdir_:
+		 * directory for temporary files (these are unlinked right after
+		 * creating them, so they are removed even if the program exits
+		 * with an error) */
+		explicit pair_agg(size_t mem_limit, const char* tmpdir_ = "/tmp") : tmpdir(tmpdir_) {
+			max_recs = mem_limit / sizeof(pair_agg_rec);
+			if(max_recs < 1024) max_recs = 1024;
+			buf.reserve(max_recs);
+			nsorted = 0;
+			spilled = 0;
+			error = false;
+		}
+		~pair_agg() {
+			for(FILE* f : runs) fclose(f);
+		}
+		pair_agg(const pair_agg&) = delete;
+		pair_agg& operator = (const pair_agg&) = delete;
+
+		/* add one edge; edges should be added in order of txid
+		 * returns false on error writing a temporary file */
+		bool add(int32_t addr_in, int32_t addr_out, double w, uint32_t txid) {
+			if(error) return false;
+			if(buf.size() == max_recs) {
+				compact();
+				if(nsorted > max_recs / 2 && !spill()) error = true;
+			}
+			buf.push_back(pair_agg_rec{addr_in,addr_out,txid,txid,1,w});
+			return !error;
+		}
+
+		size_t nruns() const { return runs.size(); }
+		uint64_t spilled_records() const { return spilled; }
+		bool has_error() const { return error; }
+
+		/* merge all data, call f for each pair in order of (addr_in, addr_out)
+		 * should be called only once, after adding all edges
+		 * returns false on error */
+		template<class F>
+		bool merge(F f) {
+			if(error) return false;
+			compact();
+			/* if there are runs on disk, the remaining data in buf is
+			 * written as the last run as well, and buf is freed, so that
+			 * the buffers for reading back the runs can use the whole
+			 * memory limit; otherwise, the data in buf is used directly
+			 * (as the last run); runs are ordered by the order of adding
+			 * the data (ties are broken by the run index when merging, so
+			 * partial sums are added in order) */
+			if(runs.size()) {
+				if(buf.size() && !spill()) {
+					error = true;
+					return false;
+				}
+				std::vector<pair_agg_rec>().swap(buf);
+			}
+			std::vector<run_reader> r(runs.size());
+			for(size_t k=0;k<runs.size();k++) {
+				if(fseek(runs[k],0,SEEK_SET)) return false;
+				r[k].f = runs[k];
+				r[k].b.resize(std::max((size_t)1024,max_recs / runs.size()));
+				r[k].i = 0;
+				r[k].n = 0;
+			}
+			size_t buf_pos = 0;
+			size_t nr = runs.size();
+
+			typedef std::pair<pair_agg_rec,size_t> qe; // record and the run it is from
+			auto cmp = [](const qe& a, const qe& b) {
+				if(!a.first.same_pair(b.first)) return b.first < a.first;
+				return b.second < a.second;
+			};
+			std::priority_queue<qe,std::vector<qe>,decltype(cmp)> q(cmp);
+			auto next = [&](size_t k) {
+				pair_agg_rec x;
+				if(k == nr) {
+					if(buf_pos < buf.size()) q.push(qe(buf[buf_pos++],k));
+				}
+				else if(r[k].next(x)) q.push(qe(x,k));
+			};
+			for(size_t k=0;k<=nr;k++) next(k);
+
+			bool have = false;
+			pair_agg_rec cur;
+			while(!q.empty()) {
+				qe x = q.top();
+				q.pop();
+				next(x.second);
+				if(have && cur.same_pair(x.first)) cur.combine(x.first);
+				else {
+					if(have) f(cur);
+					cur = x.first;
+					have = true;
+				}
+			}
+			if(have) f(cur);
+			for(size_t k=0;k<nr;k++) if(ferror(runs[k])) {
+				fprintf(stderr,"pair_agg: error reading temporary file!\n");
+				return false;
+			}
+			return true;
+		}
+};
+
+#endif /* _PAIR_AGG_H */
+
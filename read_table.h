@@ -10,6 +10,11 @@
  * version with both C and C++ interface; it requires the POSIX C getline()
  * function which is not available on all systems (most notably on Windows)
  * 
+ * regular files can be optionally memory mapped and parsed in place
+ * (see read_table_mmap() ), this requires POSIX mmap() as well;
+ * alternatively, data can be supplied in large blocks by a callback
+ * function (e.g. a decompressor, see read_table_set_reader() )
+ * 
  * note that the C++ interface requires C++11
  * 
  * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
@@ -92,6 +97,11 @@ f.close(); // close file separately -- r should not be used after this point
 #include <limits.h>
 #include <ctype.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #ifdef __cplusplus
 #include <cmath>
@@ -143,6 +153,10 @@ static const char* get_error_desc(enum read_table_errors err) {
 	}
 }
 
+/* callback to supply input data: read at most len bytes into buf, return
+ * the number of bytes read, 0 at the end of input or -1 on error */
+typedef ssize_t (*read_table_read_fn)(void* ctx, char* buf, size_t len);
+
 /* struct containing main parameters for processing text */
 typedef struct read_table_s {
 	FILE* f; /* file to be read from -- either supplied by the caller, or opened / closed in the constuctor / destructor */
@@ -155,6 +169,14 @@ typedef struct read_table_s {
 	size_t col; /* current field (column) */
 	int base; /* base for integer conversions */
 	enum read_table_errors last_error; /* error code of the last operation */
+	char* blk; /* block of input data if lines are parsed in place (a memory mapped file or a buffer filled by read_fn); buf then points inside it */
+	size_t blk_len; /* length of data in blk */
+	size_t blk_size; /* size of blk if it is allocated by us */
+	size_t blk_pos; /* start of the next line in blk */
+	size_t blk_released; /* part of blk already released with madvise() */
+	char* line_copy; /* copy of the last line if it is not terminated by a newline (in this case, buf points here) */
+	read_table_read_fn read_fn; /* callback to read data into blk (if not using a FILE) */
+	void* read_ctx; /* parameter to the previous */
 	char delim; /* delimiter to use; 0 means any blank (space or tab) note: cannot be newline */
 	char comment; /* character to indicate comments; 0 means none */
 	uint8_t flags; /* further flags: whether reading a NaN or INF for double values is considered and error */
@@ -163,12 +185,22 @@ typedef struct read_table_s {
 /* flags used above */
 #define READ_TABLE_ALLOW_NAN_INF 1
 #define READ_TABLE_CLOSE_FILE 2
+#define READ_TABLE_FAST_INT 4 /* use the built-in decimal parser instead of strto*() for integers */
+#define READ_TABLE_MMAP 8 /* blk is a memory mapped file */
 
 /* allocate new read_table struct, fill in the necessary fields */
 static void read_table_init(read_table* r, FILE* f_) {
 	r->f = f_;
 	r->buf = 0;
 	r->buf_size = 0;
+	r->blk = 0;
+	r->blk_len = 0;
+	r->blk_size = 0;
+	r->blk_pos = 0;
+	r->blk_released = 0;
+	r->line_copy = 0;
+	r->read_fn = 0;
+	r->read_ctx = 0;
 	r->line_len = 0;
 	r->line = 0;
 	r->pos = 0;
@@ -209,16 +241,156 @@ static read_table* read_table_new_fn(const char* fn_) {
 	return r;
 }
 
+/* free all buffers used by a read_table struct (not the struct itself) */
+static void read_table_free_buffers(read_table* r) {
+	if(r->blk) {
+		/* buf points inside blk or to line_copy */
+		if(r->flags & READ_TABLE_MMAP) munmap(r->blk,r->blk_len);
+		else free(r->blk);
+		if(r->line_copy) free(r->line_copy);
+	}
+	else if(r->buf) free(r->buf);
+	r->buf = 0;
+	r->buf_size = 0;
+	r->blk = 0;
+	r->blk_len = 0;
+	r->blk_size = 0;
+	r->line_copy = 0;
+	r->flags &= ~READ_TABLE_MMAP;
+}
+
 /* free read_table struct
  * note that this does not close the file, that is the caller's responsibility! */
 static void read_table_free(read_table* r) {
 	if(r) {
-		if(r->buf) free(r->buf);
+		read_table_free_buffers(r);
 		if(r->flags & READ_TABLE_CLOSE_FILE) if(r->f) fclose(r->f);
 		free(r);
 	}
 }
 
+/* try to memory map the input file and parse lines in place instead of
+ * copying them with getline(); this is only possible if the input is a
+ * regular file (not a pipe or terminal) and should be called before reading
+ * anything
+ * returns 0 on success, 1 if the file cannot be mapped -- in this case,
+ * reading continues with getline() as normal */
+static int read_table_mmap(read_table* r) {
+	if(!r || !(r->f) || r->blk || r->buf) return 1;
+	int fd = fileno(r->f);
+	struct stat st;
+	if(fd < 0 || fstat(fd,&st) || !S_ISREG(st.st_mode) || st.st_size <= 0) return 1;
+	off_t start = ftello(r->f);
+	if(start < 0 || start > st.st_size) return 1;
+	void* m = mmap(0,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	if(m == MAP_FAILED) return 1;
+#ifdef MADV_SEQUENTIAL
+	madvise(m,(size_t)st.st_size,MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+	madvise(m,(size_t)st.st_size,MADV_HUGEPAGE);
+#endif
+	r->blk = (char*)m;
+	r->blk_len = (size_t)st.st_size;
+	r->blk_pos = (size_t)start;
+	r->blk_released = 0;
+	r->flags |= READ_TABLE_MMAP;
+	return 0;
+}
+
+/* default size of the buffer used with read_fn */
+#define READ_TABLE_BLK_SIZE (((size_t)1) << 22)
+
+/* use the given callback function to obtain input data instead of reading
+ * from a file; data is read in large blocks and lines are parsed in place
+ * should be called before reading anything
+ * returns 0 on success, 1 on error (memory allocation failure) */
+static int read_table_set_reader(read_table* r, read_table_read_fn fn, void* ctx) {
+	if(!r || !fn || r->blk || r->buf) return 1;
+	r->blk = (char*)malloc(READ_TABLE_BLK_SIZE);
+	if(!r->blk) return 1;
+	r->blk_size = READ_TABLE_BLK_SIZE;
+	r->blk_len = 0;
+	r->blk_pos = 0;
+	r->read_fn = fn;
+	r->read_ctx = ctx;
+	return 0;
+}
+
+/* read more data into blk using read_fn, keeping the part starting at
+ * blk_pos (an incomplete line) -- this is moved to the beginning of the
+ * buffer, which is enlarged if needed
+ * returns the number of new bytes, 0 at the end of input, -1 on error */
+static ssize_t read_table_fill_blk(read_table* r) {
+	size_t rem = r->blk_len - r->blk_pos;
+	if(rem && r->blk_pos) memmove(r->blk,r->blk + r->blk_pos,rem);
+	r->blk_pos = 0;
+	r->blk_len = rem;
+	if(rem == r->blk_size) {
+		/* the current line does not fit in the buffer */
+		char* tmp = (char*)realloc(r->blk,2*r->blk_size);
+		if(!tmp) return -1;
+		r->blk = tmp;
+		r->blk_size *= 2;
+	}
+	ssize_t len = r->read_fn(r->read_ctx,r->blk + r->blk_len,r->blk_size - r->blk_len);
+	if(len > 0) r->blk_len += len;
+	return len;
+}
+
+/* get the next line from blk, store it in buf and line_len
+ * returns the length of the line or -1 at the end of input */
+static ssize_t read_table_getline_blk(read_table* r) {
+	const char* nl = 0;
+	if(r->read_fn) {
+		/* search for the next newline, read more data if needed */
+		size_t searched = 0;
+		while(1) {
+			nl = (const char*)memchr(r->blk + r->blk_pos + searched,'\n',
+				r->blk_len - r->blk_pos - searched);
+			if(nl) break;
+			searched = r->blk_len - r->blk_pos;
+			ssize_t len = read_table_fill_blk(r);
+			if(len < 0) {
+				r->last_error = T_READ_ERROR;
+				return -1;
+			}
+			if(len == 0) break;
+		}
+	}
+	if(r->blk_pos >= r->blk_len) return -1;
+	char* start = r->blk + r->blk_pos;
+	size_t rem = r->blk_len - r->blk_pos;
+	if(!r->read_fn) nl = (const char*)memchr(start,'\n',rem);
+	if(nl) {
+		size_t len = nl - start + 1;
+		r->buf = start;
+		r->blk_pos += len;
+#ifdef MADV_DONTNEED
+		/* release pages already processed in large chunks, so that they do
+		 * not count as used memory for very large files */
+		if((r->flags & READ_TABLE_MMAP) && r->blk_pos - r->blk_released >= (((size_t)1) << 26)) {
+			size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+			size_t end = (start - r->blk) & ~(pg - 1);
+			if(end > r->blk_released) {
+				madvise(r->blk + r->blk_released,end - r->blk_released,MADV_DONTNEED);
+				r->blk_released = end;
+			}
+		}
+#endif
+		return (ssize_t)len;
+	}
+	/* last line without a newline: copy it to be able to terminate it */
+	char* tmp = (char*)realloc(r->line_copy,rem + 1);
+	if(!tmp) return -1;
+	r->line_copy = tmp;
+	memcpy(tmp,start,rem);
+	tmp[rem] = 0;
+	r->buf = tmp;
+	r->blk_pos = r->blk_len;
+	return (ssize_t)rem;
+}
+
 /* read a new line (discarding any remaining data in the current line)
  * returns 0 if a line was read, 1 on failure
  * note that failure can mean end of file, which should be checked separately
@@ -229,11 +401,13 @@ static int read_table_line_skip(read_table* r, int skip) {
 	if(!r) return 1;
 	if(r->last_error == T_EOF || r->last_error == T_COPIED ||
 		r->last_error == T_ERROR_FOPEN) return 1;
-	if(!(r->f)) { r->last_error = T_READ_ERROR; return 1; }
+	if(!(r->f || r->blk)) { r->last_error = T_READ_ERROR; return 1; }
 	while(1) {
-		ssize_t len = getline(&(r->buf),&(r->buf_size),r->f);
+		ssize_t len;
+		if(r->blk) len = read_table_getline_blk(r);
+		else len = getline(&(r->buf),&(r->buf_size),r->f);
 		if(len < 0) {
-			r->last_error = T_EOF;
+			if(r->last_error != T_READ_ERROR) r->last_error = T_EOF;
 			r->line_len = 0; /* ensure the buffer will never be accessed */
 			return 1;
 		}
@@ -392,6 +566,95 @@ static int read_table_string(read_table* r, const char** str, size_t* len) {
 	return 0;
 }
 
+/* fast conversion of decimal integers
+ * 
+ * these are used instead of strtol() / strtoul() and related functions
+ * if the READ_TABLE_FAST_INT flag is set and base is 10; parsing
+ * the digits does not depend on the locale and processes 8 digits at
+ * a time if possible (on little-endian systems)
+ * semantics are the same as strtoll() / strtoull() with base 10 (i.e.
+ * errno is set to ERANGE on overflow, and endptr is set to s if no
+ * conversion was performed), except that leading whitespace is not
+ * skipped (this is done already by read_table_pre_check() ) and that
+ * reading stops at end */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/* check if all 8 characters in x are decimal digits */
+static inline int read_table_is_8digits(uint64_t x) {
+	return ( ( (x & 0xF0F0F0F0F0F0F0F0ULL) |
+		( ( (x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4) ) ==
+		0x3333333333333333ULL );
+}
+/* convert 8 decimal digits (first digit in the lowest byte) */
+static inline uint64_t read_table_parse_8digits(uint64_t x) {
+	x = (x & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+	x = (x & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+	return (x & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+}
+#define READ_TABLE_SWAR_DIGITS 1
+#endif
+
+/* parse optional sign and the following digits;
+ * the absolute value is stored in *res, *neg is set to 1 if there was
+ * a minus sign, *ovf is set to 1 if the value does not fit in 64 bits;
+ * returns pointer after the last digit or s if there were no digits */
+static const char* read_table_parse_dec(const char* s, const char* end,
+		uint64_t* res, int* neg, int* ovf) {
+	const char* p = s;
+	uint64_t v = 0;
+	*neg = 0;
+	*ovf = 0;
+	if(p < end && (*p == '-' || *p == '+')) {
+		if(*p == '-') *neg = 1;
+		p++;
+	}
+	const char* digits = p;
+#ifdef READ_TABLE_SWAR_DIGITS
+	/* 8 digits at a time, as long as the result cannot overflow */
+	while(end - p >= 8 && v < 184467440737ULL) { /* (UINT64_MAX - 99999999) / 100000000 */
+		uint64_t x;
+		memcpy(&x,p,8);
+		if(!read_table_is_8digits(x)) break;
+		v = v*100000000ULL + read_table_parse_8digits(x);
+		p += 8;
+	}
+#endif
+	for(;p < end;p++) {
+		unsigned int d = (unsigned char)(*p) - '0';
+		if(d > 9) break;
+		if(v > 1844674407370955161ULL || (v == 1844674407370955161ULL && d > 5)) *ovf = 1;
+		else v = v*10 + d;
+	}
+	*res = v;
+	if(p == digits) return s; /* no conversion */
+	return p;
+}
+
+static long long read_table_strtoll_dec(const char* s, const char* end, char** endptr) {
+	uint64_t v;
+	int neg, ovf;
+	*endptr = (char*)read_table_parse_dec(s,end,&v,&neg,&ovf);
+	if(neg) {
+		if(ovf || v > (uint64_t)LLONG_MAX + 1ULL) { errno = ERANGE; return LLONG_MIN; }
+		return (long long)(0ULL - v);
+	}
+	if(ovf || v > (uint64_t)LLONG_MAX) { errno = ERANGE; return LLONG_MAX; }
+	return (long long)v;
+}
+
+static unsigned long long read_table_strtoull_dec(const char* s, const char* end, char** endptr) {
+	uint64_t v;
+	int neg, ovf;
+	*endptr = (char*)read_table_parse_dec(s,end,&v,&neg,&ovf);
+	if(ovf) { errno = ERANGE; return ULLONG_MAX; }
+	return neg ? (0ULL - v) : v;
+}
+
+/* check if the fast conversion should be used */
+static inline int read_table_use_fast_int(const read_table* r) {
+	return (r->flags & READ_TABLE_FAST_INT) && r->base == 10;
+}
+
 /* try to convert the next value to integer
  * check explicitely that it is within the limits provided
  * (note: the limits are inclusive, so either min or max is OK)
@@ -400,11 +663,13 @@ static int read_table_int32_limits(read_table* r, int32_t* i, int32_t min, int32
 	if(read_table_pre_check(r)) return 1;
 	errno = 0;
 	char* c2;
-	long res = strtol(r->buf + r->pos, &c2, r->base);
+	long long res;
+	if(read_table_use_fast_int(r)) res = read_table_strtoll_dec(r->buf + r->pos, r->buf + r->line_len, &c2);
+	else res = strtol(r->buf + r->pos, &c2, r->base);
 	/* check that result fits in 32-bit integer -- long might be 64-bit */
-	if(res > (long)max || res < (long)min) {
-		if(res > (long)max) *i = max;
-		if(res < (long)min) *i = min;
+	if(res > (long long)max || res < (long long)min) {
+		if(res > (long long)max) *i = max;
+		if(res < (long long)min) *i = min;
 		r->last_error = T_OVERFLOW;
 		return 1;
 	}
@@ -427,7 +692,17 @@ static int read_table_int64_limits(read_table* r, int64_t* i, int64_t min, int64
 	/* note: try to determine if to use long or long long */
 	long res;
 	long long res2;
-	if(LONG_MAX >= INT64_MAX && LONG_MIN <= INT64_MIN) {
+	if(read_table_use_fast_int(r)) {
+		res2 = read_table_strtoll_dec(r->buf + r->pos, r->buf + r->line_len, &c2);
+		if(res2 > (long long)max || res2 < (long long)min) {
+			r->last_error = T_OVERFLOW;
+			if(res2 > (long long)max) *i = max;
+			if(res2 < (long long)min) *i = min;
+			return 1;
+		}
+		*i = res2; /* store potential result */
+	}
+	else if(LONG_MAX >= INT64_MAX && LONG_MIN <= INT64_MIN) {
 		res = strtol(r->buf + r->pos, &c2, r->base);
 		/* note: this check might be unnecessary */
 		if(res > (long)max || res < (long)min) {
@@ -469,12 +744,14 @@ static int read_table_uint32_limits(read_table* r, uint32_t* i, uint32_t min, ui
 		*i = 0;
 		return 1;
 	}
-	unsigned long res = strtoul(r->buf + r->pos, &c2, r->base);
+	unsigned long long res;
+	if(read_table_use_fast_int(r)) res = read_table_strtoull_dec(r->buf + r->pos, r->buf + r->line_len, &c2);
+	else res = strtoul(r->buf + r->pos, &c2, r->base);
 	/* check that result fits in 32-bit integer -- long might be 64-bit */
-	if(res > (unsigned long)max || res < (unsigned int)min) {
+	if(res > (unsigned long long)max || res < (unsigned long long)min) {
 		r->last_error = T_OVERFLOW;
-		if(res > (unsigned long)max) *i = max;
-		if(res < (unsigned long)min) *i = min;
+		if(res > (unsigned long long)max) *i = max;
+		if(res < (unsigned long long)min) *i = min;
 		return 1;
 	}
 	*i = res; /* store potential result */
@@ -502,7 +779,17 @@ static int read_table_uint64_limits(read_table* r, uint64_t* i, uint64_t min, ui
 	/* note: try to determine if to use long or long long */
 	unsigned long res;
 	unsigned long long res2;
-	if(ULONG_MAX >= UINT64_MAX) {
+	if(read_table_use_fast_int(r)) {
+		res2 = read_table_strtoull_dec(r->buf + r->pos, r->buf + r->line_len, &c2);
+		if(res2 > (unsigned long long)max || res2 < (unsigned long long)min) {
+			r->last_error = T_OVERFLOW;
+			if(res2 > (unsigned long long)max) *i = max;
+			if(res2 < (unsigned long long)min) *i = min;
+			return 1;
+		}
+		*i = res2; /* store potential result */
+	}
+	else if(ULONG_MAX >= UINT64_MAX) {
 		res = strtoul(r->buf + r->pos, &c2, r->base);
 		/* note: this check might be unnecessary */
 		if(res > (unsigned long)max || res < (unsigned long)min) {
@@ -615,6 +902,19 @@ static char read_table_get_comment(const read_table* r) {
 	else return 0;
 }
 
+/* use the built-in decimal parser for integers instead of strto*()
+ * (only has effect if base is 10, which is the default) */
+static void read_table_set_fast_int(read_table* r, int fast) {
+	if(r) {
+		if(fast) r->flags |= READ_TABLE_FAST_INT;
+		else r->flags &= ~READ_TABLE_FAST_INT;
+	}
+}
+static int read_table_get_fast_int(const read_table* r) {
+	if(r) return (r->flags & READ_TABLE_FAST_INT) != 0;
+	else return 0;
+}
+
 /* get last error code */
 static enum read_table_errors read_table_get_last_error(const read_table* r) {
 	if(r) return r->last_error;
@@ -639,6 +939,16 @@ static size_t read_table_get_col(const read_table* r) {
 	if(r) return r->col;
 	else return 0;
 }
+/* get the offset of the next line in the input file (i.e. the amount of
+ * data consumed so far); only known if reading a memory mapped file or a
+ * seekable FILE (for a FILE, this includes any data already buffered);
+ * returns -1 otherwise (e.g. if reading with a callback) */
+static int64_t read_table_get_offset(const read_table* r) {
+	if(!r) return -1;
+	if(r->flags & READ_TABLE_MMAP) return (int64_t)(r->blk_pos);
+	if(r->read_fn || !(r->f)) return -1;
+	return (int64_t)ftello(r->f);
+}
 /* set filename (for better formatting of diagnostic messages) */
 static void read_table_set_fn(read_table* r, const char* fn) {
 	if(r) r->fn = fn;
@@ -654,6 +964,8 @@ static void read_table_write_error(const read_table* r, FILE* f) {
 		get_error_desc(r->last_error));
 }
 
+/* note: the returned line is not NULL-terminated if lines are parsed in
+ * place from a memory mapped file, only terminated by a newline */
 static const char* read_table_get_line_str(const read_table* r) {
 	if(r) return r->buf;
 	return 0;
@@ -860,6 +1172,12 @@ struct read_table2 : public read_table {
 			 * with two different instances of this class */
 			rt_.buf = 0;
 			rt_.buf_size = 0;
+			rt_.blk = 0;
+			rt_.blk_len = 0;
+			rt_.blk_size = 0;
+			rt_.line_copy = 0;
+			rt_.read_fn = 0;
+			rt_.flags &= ~READ_TABLE_MMAP;
 			rt_.pos = 0;
 			rt_.line_len = 0;
 			rt_.col = 0;
@@ -867,12 +1185,18 @@ struct read_table2 : public read_table {
 		}
 		/* destructor frees temporary buffer */
 		~read_table2() {
-			if(buf) free(buf);
-			buf = 0;
-			buf_size = 0;
+			read_table_free_buffers(this);
 			if(flags & READ_TABLE_CLOSE_FILE) if(f) fclose(f);
 			f = 0;
 		}
+		/* try to memory map the input file (only works for regular files)
+		 * should be called before reading the first line, returns true
+		 * on success; if false is returned, reading will use getline() */
+		bool use_mmap() { return (read_table_mmap(this) == 0); }
+		/* read data using the given callback instead of a file (this should
+		 * be called before reading the first line) */
+		bool use_reader(read_table_read_fn fn, void* ctx) {
+			return (read_table_set_reader(this,fn,ctx) == 0); }
 		/* read next line into the internal buffer */
 		bool read_line(bool skip = true) {
 			if(skip) return (read_table_line_skip(this,1)==0);
@@ -936,6 +1260,9 @@ struct read_table2 : public read_table {
 		void set_comment(char comment_) { comment = comment_; }
 		/* get comment character (default is none) */
 		char get_comment() const { return comment; }
+		/* use the built-in decimal parser for integers instead of strto*() */
+		void set_fast_int(bool fast) { read_table_set_fast_int(this,fast); }
+		bool get_fast_int() const { return read_table_get_fast_int(this); }
 		
 		/* get last error code */
 		enum read_table_errors get_last_error() const { return last_error; }
@@ -945,8 +1272,10 @@ struct read_table2 : public read_table {
 		uint64_t get_line() const { return line; }
 		size_t get_pos() const { return pos; }
 		size_t get_col() const { return col; }
+		/* get the offset of the next line in the input (-1 if not known) */
+		int64_t get_offset() const { return read_table_get_offset(this); }
 		/* set filename (for better formatting of diagnostic messages) */
-		void set_fn(const char* fn_) { fn = fn; }
+		void set_fn(const char* fn_) { fn = fn_; }
 		/* get current line string */
 		const char* get_line_str() const { return read_table_get_line_str(this); }
 		
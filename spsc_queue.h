@@ -0,0 +1,106 @@
+/*  -*- C++ -*-
+ * spsc_queue.h -- bounded single producer, single consumer queue for
+ * 	passing batches of data between threads
+ *
+ * items are expected to be large (e.g. vectors of many records), so the
+ * queue uses a mutex and condition variables to block when it is empty /
+ * full instead of spinning; as a consequence, it is safe to use with
+ * multiple consumers as well (e.g. a pool of worker threads)
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+
+template<class T>
+class spsc_queue {
+	protected:
+		std::vector<T> items; // ring buffer
+		size_t head; // next item to read
+		size_t count; // number of items in the queue
+		bool closed; // producer finished (or consumer cancelled)
+		std::mutex m;
+		std::condition_variable not_empty;
+		std::condition_variable not_full;
+
+	public:
+		explicit spsc_queue(size_t size) : items(size ? size : 1), head(0), count(0), closed(false) { }
+
+		/* add one item, waiting if the queue is full
+		 * returns false if the queue was closed (item is not added) */
+		bool push(T&& x) {
+			std::unique_lock<std::mutex> lock(m);
+			not_full.wait(lock,[this]() { return closed || count < items.size(); });
+			if(closed) return false;
+			items[(head + count) % items.size()] = std::move(x);
+			count++;
+			lock.unlock();
+			not_empty.notify_one();
+			return true;
+		}
+
+		/* get the next item, waiting if the queue is empty
+		 * returns false if there are no more items (queue is empty and closed) */
+		bool pop(T& x) {
+			std::unique_lock<std::mutex> lock(m);
+			not_empty.wait(lock,[this]() { return closed || count > 0; });
+			if(count == 0) return false;
+			x = std::move(items[head]);
+			head = (head + 1) % items.size();
+			count--;
+			lock.unlock();
+			not_full.notify_one();
+			return true;
+		}
+
+		/* get the next item only if one is available without waiting */
+		bool try_pop(T& x) {
+			std::unique_lock<std::mutex> lock(m);
+			if(count == 0) return false;
+			x = std::move(items[head]);
+			head = (head + 1) % items.size();
+			count--;
+			lock.unlock();
+			not_full.notify_one();
+			return true;
+		}
+
+		/* signal that no more items will be added; items already in the
+		 * queue can still be read; a producer waiting in push() returns
+		 * (so this can be used by the consumer to cancel as well) */
+		void close() {
+			std::unique_lock<std::mutex> lock(m);
+			closed = true;
+			lock.unlock();
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+};
+
+#endif /* _SPSC_QUEUE_H */
+
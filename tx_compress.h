@@ -0,0 +1,128 @@
+/*  -*- C++ -*-
+ * tx_compress.h -- sort the (address, value) pairs of a transaction by
+ * 	address and merge pairs with the same address (summing the values)
+ *
+ * most transactions have only a few inputs and outputs, while a few have
+ * thousands; the method used depends on the number of pairs:
+ * 	1 or 2 pairs: compared directly
+ * 	up to tx_compress_small: insertion sort
+ * 	up to tx_compress_large: std::sort
+ * 	more: LSD radix sort by 8-bit digits (skipping digits that are the
+ * 		same for all addresses), using tmp as temporary storage
+ * results are the same with all methods; see bench/bench_compress.cpp for
+ * comparing them on real data
+ *
+ * example usage:
+
+std::vector<std::pair<int,int64_t> > v, tmp; // tmp is reused between calls
+... // add pairs to v
+tx_compress(v,tmp);
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TX_COMPRESS_H
+#define _TX_COMPRESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+
+typedef std::pair<int,int64_t> tx_addr_value;
+
+static const size_t tx_compress_small = 16;
+static const size_t tx_compress_large = 64;
+
+/* sort by address with insertion sort (for small vectors) */
+static inline void tx_sort_insertion(tx_addr_value* v, size_t n) {
+	for(size_t i=1;i<n;i++) {
+		tx_addr_value x = v[i];
+		size_t j = i;
+		for(;j > 0 && v[j-1].first > x.first;j--) v[j] = v[j-1];
+		v[j] = x;
+	}
+}
+
+/* sort by address with LSD radix sort; tmp is resized as needed */
+static void tx_sort_radix(std::vector<tx_addr_value>& v, std::vector<tx_addr_value>& tmp) {
+	size_t n = v.size();
+	tmp.resize(n);
+	/* count all digits in one pass; addresses are converted to unsigned
+	 * values with the same order */
+	uint32_t cnt[4][256];
+	memset(cnt,0,sizeof(cnt));
+	for(const auto& x : v) {
+		uint32_t k = ((uint32_t)x.first) ^ 0x80000000U;
+		for(unsigned int d=0;d<4;d++) cnt[d][(k >> (8*d)) & 0xFFU]++;
+	}
+	tx_addr_value* src = v.data();
+	tx_addr_value* dst = tmp.data();
+	for(unsigned int d=0;d<4;d++) {
+		uint32_t k0 = (((uint32_t)src[0].first) ^ 0x80000000U) >> (8*d) & 0xFFU;
+		if(cnt[d][k0] == n) continue; // all the same
+		uint32_t pos[256];
+		uint32_t s = 0;
+		for(unsigned int i=0;i<256;i++) {
+			pos[i] = s;
+			s += cnt[d][i];
+		}
+		for(size_t i=0;i<n;i++) {
+			uint32_t k = ((((uint32_t)src[i].first) ^ 0x80000000U) >> (8*d)) & 0xFFU;
+			dst[pos[k]++] = src[i];
+		}
+		std::swap(src,dst);
+	}
+	if(src != v.data()) v.swap(tmp);
+}
+
+/* sort v by address and merge pairs with the same address */
+static void tx_compress(std::vector<tx_addr_value>& v, std::vector<tx_addr_value>& tmp) {
+	size_t n = v.size();
+	if(n < 2) return;
+	if(n == 2) {
+		if(v[0].first == v[1].first) {
+			v[0].second += v[1].second;
+			v.pop_back();
+		}
+		else if(v[0].first > v[1].first) std::swap(v[0],v[1]);
+		return;
+	}
+	if(n <= tx_compress_small) tx_sort_insertion(v.data(),n);
+	else if(n <= tx_compress_large) std::sort(v.begin(),v.end(),
+		[](const tx_addr_value& a, const tx_addr_value& b) { return a.first < b.first; });
+	else tx_sort_radix(v,tmp);
+
+	size_t i=0;
+	for(size_t j=1;j<n;j++) {
+		if(v[i].first == v[j].first) v[i].second += v[j].second;
+		else {
+			i++;
+			if(i != j) v[i] = v[j];
+		}
+	}
+	v.resize(i+1);
+}
+
+#endif /* _TX_COMPRESS_H */
+
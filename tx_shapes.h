@@ -0,0 +1,199 @@
+/*  -*- C++ -*-
+ * tx_shapes.h -- statistics of the "shape" of transactions processed by
+ * 	txedge (txedge -K): histograms of the number of inputs, outputs,
+ * 	edges and the time taken per transaction, and the transactions with
+ * 	the most edges and taking the most time
+ *
+ * histograms use logarithmic bins: bin 0 is for the value 0, bin k > 0 is
+ * for values in [2^(k-1), 2^k); for each bin, the number of transactions,
+ * the total number of edges and the total time of these is kept, so that
+ * it is easy to see which transactions dominate the output
+ *
+ * the number of edges is the number of input and output address pairs
+ * (N x M, after merging addresses that appear multiple times), regardless
+ * of the output format; times are measured by the caller (e.g. the time
+ * between finishing the previous and the current transaction)
+ *
+ * the top K transactions are kept by the number of edges and by time, ties
+ * are broken by txid, so the result does not depend on the order of adding
+ * transactions or merging partial results
+ *
+ * example usage:
+
+tx_shapes s(20);
+s.add(txid,n_in,n_out,ns); // for each transaction
+...
+s.write_json(f); // write the results as JSON to a FILE*
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TX_SHAPES_H
+#define _TX_SHAPES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+
+/* one transaction in the top K lists */
+struct tx_shape {
+	uint32_t txid;
+	uint32_t n_in;
+	uint32_t n_out;
+	uint64_t edges;
+	uint64_t ns; // time taken
+};
+
+class tx_shapes {
+	public:
+		static const unsigned int nbins = 65;
+		enum hist_type { hist_inputs = 0, hist_outputs, hist_edges, hist_time, nhist };
+
+	protected:
+		struct bin {
+			uint64_t txs;
+			uint64_t edges;
+			uint64_t ns;
+		};
+		bin hist[nhist][nbins];
+		size_t k;
+		uint64_t txs;
+		uint64_t edges;
+		uint64_t ns;
+		/* top K transactions, as heaps with the smallest one at the top */
+		std::vector<tx_shape> top_edges;
+		std::vector<tx_shape> top_time;
+
+		static unsigned int bin_index(uint64_t x) {
+			if(x == 0) return 0;
+			return 64 - __builtin_clzll(x);
+		}
+		/* order for the top K: more edges (or time) first, then smaller txid */
+		static bool more_edges(const tx_shape& a, const tx_shape& b) {
+			if(a.edges != b.edges) return a.edges > b.edges;
+			return a.txid < b.txid;
+		}
+		static bool more_time(const tx_shape& a, const tx_shape& b) {
+			if(a.ns != b.ns) return a.ns > b.ns;
+			return a.txid < b.txid;
+		}
+		template<class cmp>
+		void add_top(std::vector<tx_shape>& top, const tx_shape& x, cmp c) {
+			if(top.size() < k) {
+				top.push_back(x);
+				std::push_heap(top.begin(),top.end(),c);
+			}
+			else if(k && c(x,top.front())) {
+				std::pop_heap(top.begin(),top.end(),c);
+				top.back() = x;
+				std::push_heap(top.begin(),top.end(),c);
+			}
+		}
+		void add_bin(hist_type h, uint64_t x, uint64_t e, uint64_t t) {
+			bin& b = hist[h][bin_index(x)];
+			b.txs++;
+			b.edges += e;
+			b.ns += t;
+		}
+
+	public:
+		/* k_: number of transactions to keep in the top lists */
+		explicit tx_shapes(size_t k_ = 20) : k(k_), txs(0), edges(0), ns(0) {
+			for(unsigned int h=0;h<nhist;h++) for(unsigned int i=0;i<nbins;i++) hist[h][i] = bin{0,0,0};
+		}
+
+		/* add one transaction with n_in inputs and n_out outputs, that
+		 * took ns_ nanoseconds to process */
+		void add(uint32_t txid, uint32_t n_in, uint32_t n_out, uint64_t ns_) {
+			uint64_t e = ((uint64_t)n_in) * ((uint64_t)n_out);
+			add_bin(hist_inputs,n_in,e,ns_);
+			add_bin(hist_outputs,n_out,e,ns_);
+			add_bin(hist_edges,e,e,ns_);
+			add_bin(hist_time,ns_,e,ns_);
+			txs++;
+			edges += e;
+			ns += ns_;
+			tx_shape x{txid,n_in,n_out,e,ns_};
+			add_top(top_edges,x,more_edges);
+			add_top(top_time,x,more_time);
+		}
+
+		/* add the results collected in another instance */
+		void merge(const tx_shapes& s) {
+			for(unsigned int h=0;h<nhist;h++) for(unsigned int i=0;i<nbins;i++) {
+				hist[h][i].txs += s.hist[h][i].txs;
+				hist[h][i].edges += s.hist[h][i].edges;
+				hist[h][i].ns += s.hist[h][i].ns;
+			}
+			txs += s.txs;
+			edges += s.edges;
+			ns += s.ns;
+			for(const tx_shape& x : s.top_edges) add_top(top_edges,x,more_edges);
+			for(const tx_shape& x : s.top_time) add_top(top_time,x,more_time);
+		}
+
+		uint64_t size() const { return txs; }
+		size_t top_k() const { return k; }
+
+		/* write the results as JSON: totals, histograms (only the non-empty
+		 * bins, with the range of values in each) and the top K lists */
+		bool write_json(FILE* f) const {
+			static const char* const names[nhist] = {"inputs","outputs","edges","time_ns"};
+			fprintf(f,"{\n\t\"transactions\": %lu,\n\t\"edges\": %lu,\n\t\"time_ns\": %lu,\n",
+				(unsigned long)txs,(unsigned long)edges,(unsigned long)ns);
+			fprintf(f,"\t\"histograms\": {");
+			for(unsigned int h=0;h<nhist;h++) {
+				fprintf(f,"%s\n\t\t\"%s\": [",h ? "," : "",names[h]);
+				bool first = true;
+				for(unsigned int i=0;i<nbins;i++) {
+					const bin& b = hist[h][i];
+					if(!b.txs) continue;
+					uint64_t min = i ? (1ULL << (i-1)) : 0;
+					uint64_t max = i ? ((i < 64) ? (1ULL << i) - 1 : UINT64_MAX) : 0;
+					fprintf(f,"%s\n\t\t\t{\"min\": %lu, \"max\": %lu, \"transactions\": %lu, \"edges\": %lu, \"time_ns\": %lu}",
+						first ? "" : ",",(unsigned long)min,(unsigned long)max,(unsigned long)b.txs,
+						(unsigned long)b.edges,(unsigned long)b.ns);
+					first = false;
+				}
+				fprintf(f,"\n\t\t]");
+			}
+			fprintf(f,"\n\t},\n");
+			const char* const top_names[2] = {"top_edges","top_time"};
+			for(unsigned int j=0;j<2;j++) {
+				std::vector<tx_shape> top = j ? top_time : top_edges;
+				if(j) std::sort(top.begin(),top.end(),more_time);
+				else std::sort(top.begin(),top.end(),more_edges);
+				fprintf(f,"\t\"%s\": [",top_names[j]);
+				for(size_t i=0;i<top.size();i++)
+					fprintf(f,"%s\n\t\t{\"txid\": %u, \"inputs\": %u, \"outputs\": %u, \"edges\": %lu, \"time_ns\": %lu}",
+						i ? "," : "",top[i].txid,top[i].n_in,top[i].n_out,(unsigned long)top[i].edges,
+						(unsigned long)top[i].ns);
+				fprintf(f,"\n\t]%s\n",j ? "" : ",");
+			}
+			fprintf(f,"}\n");
+			return !ferror(f);
+		}
+};
+
+#endif /* _TX_SHAPES_H */
+
@@ -0,0 +1,291 @@
+/*  -*- C++ -*-
+ * txaddr_stats.h -- statistics of each address computed while processing
+ * 	transactions (txedge -S), and the binary file format for them; also
+ * 	includes a reader that memory maps such files
+ *
+ * for each address, the following are kept (for the NxM edges created
+ * from the transactions, as in txedge):
+ * 	out-degree and in-degree (number of edges from and to the address,
+ * 		i.e. an input address of a transaction with M output addresses
+ * 		has M edges from it)
+ * 	total weight of edges from and to the address (sent and received);
+ * 		these are computed per transaction as input value * total output /
+ * 		total input, and as the output value, which are equal to the sum
+ * 		of edge weights up to rounding
+ * 	first and last txid where the address appears
+ * statistics are stored in an array indexed by address + 1 (so that -1 is
+ * included), split into pages allocated as needed, so memory use depends
+ * on the range of addresses present
+ *
+ * binary format (all values are little-endian):
+ * 	header (32 bytes):
+ * 		0: magic "TXADDRS" + '\0'
+ * 		8: uint32 version (currently 1)
+ * 		12: uint32 size of one record (48)
+ * 		16: uint64 number of records
+ * 		24-31: reserved (zero)
+ * 	records (48 bytes each, ordered by address):
+ * 		0: int32 address
+ * 		4: uint32 first txid
+ * 		8: uint32 last txid
+ * 		12: uint32 reserved (zero)
+ * 		16: uint64 out-degree
+ * 		24: uint64 in-degree
+ * 		32: double total weight sent
+ * 		40: double total weight received
+ *
+ * example usage:
+
+txaddr_stats_reader r;
+if(!r.open("stats.bin")) ... // handle error
+for(const txaddr_stats_record& x : r) ... // use x.addr, x.deg_out, etc.
+
+ * note: the reader only supports little-endian systems, since records are
+ * accessed directly in the memory mapped file
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TXADDR_STATS_H
+#define _TXADDR_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <vector>
+#include "txedge_bin.h" // txedge_bin_put32() and similar
+#include "format_num.h"
+
+
+static const char txaddr_stats_magic[8] = {'T','X','A','D','D','R','S',0};
+static const uint32_t txaddr_stats_version = 1;
+static const size_t txaddr_stats_header_size = 32;
+static const size_t txaddr_stats_record_size = 48;
+
+/* one record as stored in the file (on little-endian systems) */
+struct txaddr_stats_record {
+	int32_t addr;
+	uint32_t first_txid;
+	uint32_t last_txid;
+	uint32_t reserved;
+	uint64_t deg_out;
+	uint64_t deg_in;
+	double sent;
+	double received;
+};
+static_assert(sizeof(txaddr_stats_record) == 48, "txaddr_stats_record: unexpected size!");
+
+
+/* statistics of all addresses */
+class txaddr_stats {
+	protected:
+		/* statistics of one address (deg_out == deg_in == 0 if not seen) */
+		struct stats {
+			uint64_t deg_out;
+			uint64_t deg_in;
+			double sent;
+			double received;
+			uint32_t first_txid;
+			uint32_t last_txid;
+		};
+		static const unsigned int page_bits = 16;
+		static const uint32_t page_size = (1U << page_bits);
+		std::vector<std::vector<stats> > pages;
+		uint64_t naddr; // number of addresses seen
+
+		stats& get(int32_t addr, uint32_t txid) {
+			uint32_t i = (uint32_t)((int64_t)addr + 1);
+			std::vector<stats>& p = pages[i >> page_bits];
+			if(p.empty()) p.resize(page_size,stats{0,0,0.0,0.0,0,0});
+			stats& s = p[i & (page_size - 1)];
+			if(!(s.deg_out || s.deg_in)) {
+				s.first_txid = txid;
+				naddr++;
+			}
+			s.last_txid = txid;
+			return s;
+		}
+
+		static void encode(char* p, int32_t addr, const stats& s) {
+			uint64_t x;
+			memset(p,0,txaddr_stats_record_size);
+			txedge_bin_put32(p,(uint32_t)addr);
+			txedge_bin_put32(p+4,s.first_txid);
+			txedge_bin_put32(p+8,s.last_txid);
+			txedge_bin_put64(p+16,s.deg_out);
+			txedge_bin_put64(p+24,s.deg_in);
+			memcpy(&x,&s.sent,8);
+			txedge_bin_put64(p+32,x);
+			memcpy(&x,&s.received,8);
+			txedge_bin_put64(p+40,x);
+		}
+
+	public:
+		txaddr_stats() : pages(1U << (32 - page_bits)), naddr(0) { }
+
+		/* add one transaction; inputs and outputs are (address, value)
+		 * pairs with distinct addresses (given as iterators) */
+		template<class it>
+		void add_tx(uint32_t txid, it in_begin, it in_end, it out_begin, it out_end) {
+			int64_t tmp = 0;
+			for(it x = in_begin;x != in_end;++x) tmp += x->second;
+			double sum_in = (double)tmp;
+			tmp = 0;
+			for(it x = out_begin;x != out_end;++x) tmp += x->second;
+			double sum_out = (double)tmp;
+			uint64_t n_in = in_end - in_begin;
+			uint64_t n_out = out_end - out_begin;
+			if(!(n_in && n_out)) return;
+			for(it x = in_begin;x != in_end;++x) {
+				stats& s = get(x->first,txid);
+				s.deg_out += n_out;
+				if(sum_in > 0.0) s.sent += ((double)(x->second)) * (sum_out / sum_in);
+			}
+			for(it x = out_begin;x != out_end;++x) {
+				stats& s = get(x->first,txid);
+				s.deg_in += n_in;
+				if(sum_in > 0.0) s.received += (double)(x->second);
+			}
+		}
+
+		uint64_t size() const { return naddr; }
+
+		/* write all addresses seen to o (buf_writer) in order of addresses,
+		 * either as TSV (address, out-degree, in-degree, sent, received,
+		 * first txid, last txid; weights formatted with the given function,
+		 * e.g. format_double17()) or in the binary format */
+		template<class out_buf, class format_double_fn>
+		void write(out_buf& o, bool binary, format_double_fn fd) const {
+			if(binary) {
+				char* p = o.reserve(txaddr_stats_header_size);
+				memset(p,0,txaddr_stats_header_size);
+				memcpy(p,txaddr_stats_magic,8);
+				txedge_bin_put32(p+8,txaddr_stats_version);
+				txedge_bin_put32(p+12,txaddr_stats_record_size);
+				txedge_bin_put64(p+16,naddr);
+				o.commit(txaddr_stats_header_size);
+			}
+			for(size_t j=0;j<pages.size();j++) for(uint32_t k=0;k<pages[j].size();k++) {
+				const stats& s = pages[j][k];
+				if(!(s.deg_out || s.deg_in)) continue;
+				int32_t addr = (int32_t)((int64_t)(j*page_size + k) - 1);
+				if(binary) {
+					encode(o.reserve(txaddr_stats_record_size),addr,s);
+					o.commit(txaddr_stats_record_size);
+					continue;
+				}
+				char* p = o.reserve(160);
+				char* p0 = p;
+				p = format_int32(p,addr);
+				*p++ = '\t';
+				p = format_uint64(p,s.deg_out);
+				*p++ = '\t';
+				p = format_uint64(p,s.deg_in);
+				*p++ = '\t';
+				p = fd(p,s.sent);
+				*p++ = '\t';
+				p = fd(p,s.received);
+				*p++ = '\t';
+				p = format_uint32(p,s.first_txid);
+				*p++ = '\t';
+				p = format_uint32(p,s.last_txid);
+				*p++ = '\n';
+				o.commit(p - p0);
+			}
+		}
+};
+
+
+/* read a binary file by memory mapping it */
+class txaddr_stats_reader {
+	protected:
+		char* map;
+		size_t map_size;
+		uint64_t n;
+
+	public:
+		txaddr_stats_reader() : map(0), map_size(0), n(0) { }
+		~txaddr_stats_reader() { close(); }
+		txaddr_stats_reader(const txaddr_stats_reader&) = delete;
+		txaddr_stats_reader& operator = (const txaddr_stats_reader&) = delete;
+
+		/* open and map the given file, check the header
+		 * returns false on error (an error message is written to stderr) */
+		bool open(const char* fn) {
+			close();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+			fprintf(stderr,"txaddr_stats_reader: only little-endian systems are supported!\n");
+			return false;
+#endif
+			int fd = ::open(fn,O_RDONLY);
+			if(fd < 0) {
+				fprintf(stderr,"txaddr_stats_reader: cannot open file %s!\n",fn);
+				return false;
+			}
+			struct stat st;
+			if(fstat(fd,&st) || (size_t)st.st_size < txaddr_stats_header_size) {
+				fprintf(stderr,"txaddr_stats_reader: invalid file %s!\n",fn);
+				::close(fd);
+				return false;
+			}
+			void* m = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+			::close(fd);
+			if(m == MAP_FAILED) {
+				fprintf(stderr,"txaddr_stats_reader: cannot map file %s!\n",fn);
+				return false;
+			}
+			map = (char*)m;
+			map_size = st.st_size;
+			n = txedge_bin_get64(map+16);
+			if(memcmp(map,txaddr_stats_magic,8) || txedge_bin_get32(map+8) != txaddr_stats_version ||
+					txedge_bin_get32(map+12) != txaddr_stats_record_size ||
+					n > (map_size - txaddr_stats_header_size) / txaddr_stats_record_size) {
+				fprintf(stderr,"txaddr_stats_reader: invalid header in file %s!\n",fn);
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+			if(map) munmap(map,map_size);
+			map = 0;
+			map_size = 0;
+			n = 0;
+		}
+
+		/* number of records */
+		uint64_t size() const { return n; }
+		/* access records directly */
+		const txaddr_stats_record* data() const {
+			return (const txaddr_stats_record*)(map + txaddr_stats_header_size);
+		}
+		const txaddr_stats_record& operator [] (uint64_t i) const { return data()[i]; }
+		const txaddr_stats_record* begin() const { return data(); }
+		const txaddr_stats_record* end() const { return data() + n; }
+};
+
+#endif /* _TXADDR_STATS_H */
+
@@ -23,6 +23,18 @@
  */
 
 #include "read_table.h"
+#include "zinput.h"
+#include "spsc_queue.h"
+#include "buf_writer.h"
+#include "format_num.h"
+#include "txedge_bin.h"
+#include "txedge_col.h"
+#include "txindex.h"
+#include "pair_agg.h"
+#include "txedge_csr.h"
+#include "txaddr_stats.h"
+#include "tx_compress.h"
+#include "tx_shapes.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -30,6 +42,18 @@
 #include <utility> //std::pair
 #include <algorithm>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 
 struct txrecord {
@@ -38,6 +62,130 @@ struct txrecord {
 	int64_t value;
 };
 
+/* stages of processing for which the time spent is measured (see
+ * txedge_timer) */
+enum txedge_stage { stage_decompress = 0, stage_parse, stage_join, stage_weight, stage_format, stage_write, txedge_nstages };
+static const char* const txedge_stage_names[txedge_nstages] = {"decompress","parse","join","weight","format","write"};
+
+/* measure the time spent in a stage while an instance exists (only if
+ * enabled with txedge_timer::enable(), otherwise this does nothing);
+ * totals are summed over all threads and are exclusive, i.e. time spent in
+ * a stage nested in another one in the same thread (e.g. decompressing
+ * while parsing) is only counted for the inner one */
+class txedge_timer {
+	protected:
+		txedge_stage s;
+		bool on;
+		uint64_t n0;
+		std::chrono::steady_clock::time_point t0;
+		
+		static bool& enabled() { static bool e = false; return e; }
+		static std::atomic<uint64_t>* totals() { static std::atomic<uint64_t> t[txedge_nstages] = {}; return t; }
+		// total time measured in the current thread (used to exclude nested stages)
+		static uint64_t& nested() { static thread_local uint64_t n = 0; return n; }
+		
+	public:
+		explicit txedge_timer(txedge_stage s_) : s(s_), on(enabled()) {
+			if(on) {
+				n0 = nested();
+				t0 = std::chrono::steady_clock::now();
+			}
+		}
+		~txedge_timer() {
+			if(!on) return;
+			uint64_t d = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+			uint64_t inner = nested() - n0;
+			totals()[s] += (d > inner) ? (d - inner) : 0;
+			nested() = n0 + d;
+		}
+		txedge_timer(const txedge_timer&) = delete;
+		txedge_timer& operator = (const txedge_timer&) = delete;
+		
+		/* add time measured elsewhere (in nanoseconds) */
+		static void add(txedge_stage s, uint64_t ns) {
+			if(!enabled()) return;
+			totals()[s] += ns;
+			nested() += ns;
+		}
+		/* should be called before starting any threads */
+		static void enable() { enabled() = true; }
+		static bool is_enabled() { return enabled(); }
+		/* total time spent in the given stage in seconds */
+		static double total(txedge_stage s) { return totals()[s] * 1e-9; }
+};
+
+/* amount of output written to stdout (and the mining output), and the
+ * time spent writing it (see buf_writer) */
+static std::atomic<uint64_t> txedge_out_bytes(0);
+static void txedge_write_stats(uint64_t ns, size_t n) {
+	txedge_timer::add(stage_write,ns);
+	txedge_out_bytes += n;
+}
+
+/* input file: either an uncompressed file or a compressed file decoded in-process */
+struct txinput {
+	FILE* f;
+	zinput* z;
+	
+	txinput() : f(0), z(0) { }
+	~txinput() { close(); }
+	
+	bool open(const char* fn, bool pgz, bool pxz, unsigned int threads) {
+		close();
+		if(pxz) z = zinput::open(fn,zinput::xz,threads);
+		else if(pgz) z = zinput::open(fn,zinput::gzip,threads);
+		else {
+			f = fopen(fn,"r");
+			if(!f) fprintf(stderr,"txinput::open(): error opening file: %s\n",fn);
+		}
+		return is_open();
+	}
+	void close() {
+		if(f) fclose(f);
+		if(z) delete z;
+		f = 0;
+		z = 0;
+	}
+	bool is_open() const { return f || z; }
+	
+	/* start reading at the last checkpoint before the given txid if there
+	 * is an index for the file fn (in fn.idx, see txindex.h); should be
+	 * called before reading anything; returns true if seeking was done */
+	bool seek(const char* fn, uint32_t txid) {
+		if(txid == 0) return false;
+		std::string idx_fn = std::string(fn) + ".idx";
+		tx_index idx;
+		if(!idx.read(idx_fn.c_str(),fn)) return false;
+		const tx_index_entry* e = idx.find(txid);
+		if(!e) return false;
+		if(z) {
+			xz_input* x = dynamic_cast<xz_input*>(z);
+			if(!x || !idx.is_xz()) return false;
+			return x->seek_block(e->block_offset,idx.get_index_offset(),
+				idx.get_size() - e->block_uoffset,e->line_uoffset - e->block_uoffset);
+		}
+		if(idx.is_xz()) return false;
+		return !fseeko(f,(off_t)e->line_uoffset,SEEK_SET);
+	}
+	
+	/* callback for reading from z (given as ctx), measuring the time taken */
+	static ssize_t read_cb(void* ctx, char* buf, size_t len) {
+		txedge_timer t(stage_decompress);
+		return zinput::read_cb(ctx,buf,len);
+	}
+};
+
+/* set up rt (created with in.f) to read from in; compressed files are
+ * decoded in-process in large blocks, regular files are parsed in place
+ * (pipes are read line by line) */
+static bool txinput_setup(read_table2& rt, const txinput& in, const char* fn) {
+	rt.set_fast_int(true);
+	rt.set_fn(fn);
+	if(in.z) return rt.use_reader(txinput::read_cb,in.z);
+	rt.use_mmap();
+	return true;
+}
+
 struct txedge {
 	unsigned int txid;
 	int addr_in;
@@ -45,36 +193,542 @@ struct txedge {
 	double w;
 };
 
+/* edges of one or more transactions as struct of arrays (see
+ * tx_t::get_edges()); reused between transactions to avoid allocations */
+static const size_t tx_batch_max_edges = 65536; // edges of large transactions are processed in batches of this size
+struct tx_batch {
+	std::vector<uint32_t> txid;
+	std::vector<int32_t> addr_in;
+	std::vector<int32_t> addr_out;
+	std::vector<double> w;
+	std::vector<double> in_values; // temporary storage for computing weights
+	std::vector<double> out_ratios;
+	
+	size_t size() const { return txid.size(); }
+	void clear() {
+		txid.clear();
+		addr_in.clear();
+		addr_out.clear();
+		w.clear();
+	}
+};
+
+/* weights of all edges of a transaction: w[i*m + j] = in[i] * ratio[j],
+ * where ratio[j] = out[j] / sum is computed once for each output; this
+ * gives exactly the same values as computing in[i] * (out[j] / sum) for
+ * each edge; with gcc, versions for AVX2 and AVX-512 are compiled as well,
+ * selected at runtime based on the CPU */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(TXEDGE_NO_TARGET_CLONES)
+__attribute__((target_clones("avx512f","avx2","default")))
+#endif
+void tx_weights_kernel(const double* __restrict in, size_t n, const double* __restrict ratio, size_t m, double* __restrict w) {
+	for(size_t i=0;i<n;i++) {
+		double a = in[i];
+		double* wi = w + i*m;
+		for(size_t j=0;j<m;j++) wi[j] = a * ratio[j];
+	}
+}
+
+
+/* timestamps of transactions, i.e. txid -> timestamp of the block
+ * containing the transaction, read from tx.dat (txid, block ID, ...) and
+ * bh.dat (block ID, hash, timestamp, ...); txids are dense, so timestamps
+ * are stored in an array indexed by txid, split into pages allocated as
+ * needed (memory use is proportional to the range of txids present)
+ * optionally, only transactions in a time window are stored, which can be
+ * used to select the range of transactions to process */
+class tx_times {
+	protected:
+		static const unsigned int page_bits = 16;
+		static const uint32_t page_size = (1U << page_bits);
+		std::vector<std::vector<uint32_t> > pages; // indexed by txid >> page_bits
+		std::vector<uint32_t> block_ts; // timestamp of each block
+		uint32_t ts_min; // time window to store (ts_min <= ts < ts_end)
+		uint64_t ts_end;
+		uint32_t txid_min; // range of txids stored (txid_min <= txid < txid_end)
+		uint64_t txid_end;
+		
+		// read both files, return true on success
+		bool read_blocks(read_table2& rt) {
+			while(rt.read_line()) {
+				uint32_t block, ts;
+				if(!(rt.read_uint32(block) && rt.read_skip() && rt.read_uint32(ts))) break;
+				if(block >= block_ts.size()) block_ts.resize(std::max((size_t)block + 1,2*block_ts.size()),0);
+				block_ts[block] = ts;
+			}
+			return rt.get_last_error() == T_EOF;
+		}
+		bool read_txs(read_table2& rt) {
+			while(rt.read_line()) {
+				uint32_t txid, block;
+				if(!(rt.read_uint32(txid) && rt.read_uint32(block))) break;
+				uint32_t ts = (block < block_ts.size()) ? block_ts[block] : 0;
+				if(ts < ts_min || ts >= ts_end) continue;
+				if(txid_end == 0 || txid < txid_min) txid_min = txid;
+				if(txid >= txid_end) txid_end = ((uint64_t)txid) + 1;
+				std::vector<uint32_t>& p = pages[txid >> page_bits];
+				if(p.empty()) p.resize(page_size,0);
+				p[txid & (page_size - 1)] = ts;
+			}
+			return rt.get_last_error() == T_EOF;
+		}
+		
+	public:
+		tx_times() : pages(1U << (32 - page_bits)), ts_min(0), ts_end(UINT64_MAX), txid_min(0), txid_end(0) { }
+		
+		/* only store transactions with ts_min_ <= timestamp < ts_end_
+		 * (should be called before read()) */
+		void set_window(uint32_t ts_min_, uint64_t ts_end_) {
+			ts_min = ts_min_;
+			ts_end = ts_end_;
+		}
+		
+		/* range of txids stored, txid_min_ <= txid < txid_end_ (empty if
+		 * no transactions were found) */
+		void get_range(uint32_t& txid_min_, uint64_t& txid_end_) const {
+			txid_min_ = txid_min;
+			txid_end_ = txid_end;
+		}
+		
+		/* read the block and transaction files (already opened); fn_tx
+		 * and fn_bh are only used for error messages */
+		bool read(const txinput& tx_in, const char* fn_tx, const txinput& bh_in, const char* fn_bh) {
+			read_table2 rt_bh(bh_in.f);
+			if(!txinput_setup(rt_bh,bh_in,fn_bh)) return false;
+			if(!read_blocks(rt_bh)) {
+				fprintf(stderr,"tx_times: ");
+				rt_bh.write_error(stderr);
+				return false;
+			}
+			read_table2 rt_tx(tx_in.f);
+			if(!txinput_setup(rt_tx,tx_in,fn_tx)) return false;
+			if(!read_txs(rt_tx)) {
+				fprintf(stderr,"tx_times: ");
+				rt_tx.write_error(stderr);
+				return false;
+			}
+			return true;
+		}
+		
+		/* timestamp of the given transaction (0 if not known or outside the
+		 * time window) */
+		uint32_t get(uint32_t txid) const {
+			const std::vector<uint32_t>& p = pages[txid >> page_bits];
+			return p.empty() ? 0 : p[txid & (page_size - 1)];
+		}
+};
+
+
+/* dense renumbering of addresses: each address gets a new ID (0, 1, 2, ...)
+ * in the order they are first seen; new IDs are stored in an array indexed
+ * by address + 1 (so that -1 is included), split into pages allocated as
+ * needed, while the original addresses are stored in order of new IDs
+ * note: IDs are assigned by one thread (the main thread or the splitter
+ * when processing in parallel), so no synchronization is needed (except
+ * for unknown_id(), which can be read by other threads) */
+class addr_map {
+	protected:
+		static const unsigned int page_bits = 16;
+		static const uint32_t page_size = (1U << page_bits);
+		std::vector<std::vector<int32_t> > pages; // new ID + 1 (0 if not seen yet)
+		std::vector<int32_t> addrs; // original address of each new ID
+		std::atomic<int32_t> unknown; // new ID of the unknown address (-1 if not seen yet)
+		
+	public:
+		addr_map() : pages(1U << (32 - page_bits)), unknown(-1) { }
+		
+		/* get the new ID of an address, assigning the next one if not seen before */
+		int32_t map(int32_t addr) {
+			uint32_t i = (uint32_t)((int64_t)addr + 1);
+			std::vector<int32_t>& p = pages[i >> page_bits];
+			if(p.empty()) p.resize(page_size,0);
+			int32_t& x = p[i & (page_size - 1)];
+			if(!x) {
+				addrs.push_back(addr);
+				x = (int32_t)addrs.size();
+				if(addr == -1) unknown.store(x - 1,std::memory_order_relaxed);
+			}
+			return x - 1;
+		}
+		
+		/* new ID of the unknown address (-1), or -1 if it was not seen yet
+		 * (so no other address has been renumbered to this yet) */
+		int32_t unknown_id() const { return unknown.load(std::memory_order_relaxed); }
+		
+		size_t size() const { return addrs.size(); }
+		
+		/* original address of a new ID (which has to be assigned already) */
+		int32_t orig(int32_t id) const { return addrs[id]; }
+		
+		/* write the table as TSV (new ID, original address), return true on success */
+		bool write(const char* fn) const {
+			int fd = open(fn,O_WRONLY | O_CREAT | O_TRUNC,0644);
+			if(fd < 0) return false;
+			bool ret;
+			{
+				buf_writer w(fd,1U << 20);
+				for(size_t i=0;i<addrs.size();i++) {
+					char* p = w.reserve(32);
+					char* p0 = p;
+					p = format_uint32(p,i);
+					*p++ = '\t';
+					p = format_int32(p,addrs[i]);
+					*p++ = '\n';
+					w.commit(p - p0);
+				}
+				w.close();
+				ret = !w.has_error();
+			}
+			return (close(fd) == 0) && ret;
+		}
+};
+
+
+/* clusters of addresses using the common-input heuristic (all input
+ * addresses of a transaction belong to the same entity), computed with
+ * union-find; nodes are addresses + 1 (so that -1 is included), the parent
+ * of each node is stored in an array split into pages allocated as needed
+ * (as parent + 1, 0 if the address was not seen); the root of each cluster
+ * is always its smallest node, so cluster IDs are the smallest address in
+ * each cluster, independently of the order of unions
+ * unions are done by one thread (the main thread or the thread writing the
+ * output when processing in parallel); after flatten(), lookup() does not
+ * modify the table, so it can be used from multiple threads */
+class addr_clusters {
+	protected:
+		static const unsigned int page_bits = 16;
+		static const uint32_t page_size = (1U << page_bits);
+		std::vector<std::vector<uint32_t> > pages; // parent + 1 of each node (0 if not seen)
+		
+		uint32_t& parent1(uint32_t i) {
+			std::vector<uint32_t>& p = pages[i >> page_bits];
+			if(p.empty()) p.resize(page_size,0);
+			return p[i & (page_size - 1)];
+		}
+		/* find the root of node i (which has to be seen already), with path halving */
+		uint32_t find(uint32_t i) {
+			while(true) {
+				uint32_t& p = parent1(i);
+				if(p - 1 == i) return i;
+				uint32_t gp = parent1(p - 1);
+				p = gp; // point to the grandparent
+				i = gp - 1;
+			}
+		}
+		uint32_t add_node(uint32_t i) {
+			uint32_t& p = parent1(i);
+			if(!p) p = i + 1;
+			return i;
+		}
+		
+	public:
+		addr_clusters() : pages(1U << (32 - page_bits)) { }
+		
+		/* add the addresses of a transaction: inputs are put into the same
+		 * cluster, outputs are only added as separate clusters if not seen;
+		 * the unknown address (-1, or the ID it was renumbered to, given as
+		 * unknown) is not joined with anything, since it does not belong to
+		 * one entity (it is only added as a separate cluster) */
+		template<class it>
+		void add_tx(it in_begin, it in_end, it out_begin, it out_end, int32_t unknown = -1) {
+			uint32_t r = 0;
+			bool have_r = false;
+			for(it x = in_begin;x != in_end;++x) {
+				uint32_t a = find(add_node((uint32_t)((int64_t)x->first + 1)));
+				if(x->first == unknown) continue;
+				if(!have_r) {
+					r = a;
+					have_r = true;
+					continue;
+				}
+				if(a == r) continue;
+				if(a < r) std::swap(a,r);
+				parent1(a) = r + 1; // the smaller node is the root
+			}
+			for(it x = out_begin;x != out_end;++x) add_node((uint32_t)((int64_t)x->first + 1));
+		}
+		
+		/* replace nodes by the original addresses if the clusters were
+		 * computed with addresses renumbered by m, so that the table
+		 * written has original addresses and cluster IDs (the same as
+		 * without renumbering) */
+		void unmap(const addr_map& m) {
+			addr_clusters tmp;
+			std::pair<int32_t,int64_t> x[2] = {{0,0},{0,0}};
+			for(size_t j=0;j<pages.size();j++) for(uint32_t k=0;k<pages[j].size();k++) {
+				if(!pages[j][k]) continue;
+				uint32_t i = j*page_size + k;
+				x[0].first = m.orig((int32_t)((int64_t)i - 1));
+				x[1].first = m.orig((int32_t)((int64_t)find(i) - 1));
+				tmp.add_tx(x,x+2,x+2,x+2); // same cluster as its root
+			}
+			pages.swap(tmp.pages);
+		}
+		
+		/* point all nodes directly to their root */
+		void flatten() {
+			for(size_t j=0;j<pages.size();j++) for(uint32_t k=0;k<pages[j].size();k++)
+				if(pages[j][k]) pages[j][k] = find(j*page_size + k) + 1;
+		}
+		
+		/* cluster ID of an address (the address itself if not seen); the
+		 * table should be flattened first */
+		int32_t lookup(int32_t addr) const {
+			uint32_t i = (uint32_t)((int64_t)addr + 1);
+			const std::vector<uint32_t>& p = pages[i >> page_bits];
+			if(p.empty() || !p[i & (page_size - 1)]) return addr;
+			return (int32_t)((int64_t)p[i & (page_size - 1)] - 2);
+		}
+		
+		/* write the table as TSV (address, cluster ID) in order of addresses;
+		 * returns the number of clusters or -1 on error */
+		int64_t write(const char* fn) {
+			int fd = open(fn,O_WRONLY | O_CREAT | O_TRUNC,0644);
+			if(fd < 0) return -1;
+			int64_t nclusters = 0;
+			bool ret;
+			{
+				buf_writer w(fd,1U << 20);
+				for(size_t j=0;j<pages.size();j++) for(uint32_t k=0;k<pages[j].size();k++) {
+					if(!pages[j][k]) continue;
+					uint32_t i = j*page_size + k;
+					uint32_t r = find(i);
+					if(r == i) nclusters++;
+					char* p = w.reserve(32);
+					char* p0 = p;
+					p = format_int32(p,(int32_t)((int64_t)i - 1));
+					*p++ = '\t';
+					p = format_int32(p,(int32_t)((int64_t)r - 1));
+					*p++ = '\n';
+					w.commit(p - p0);
+				}
+				w.close();
+				ret = !w.has_error();
+			}
+			if(close(fd) || !ret) return -1;
+			return nclusters;
+		}
+		
+		/* read a table written by write() (address, cluster ID); returns
+		 * true on success (the table is flattened as well) */
+		bool read(const txinput& in, const char* fn) {
+			read_table2 rt(in.f);
+			if(!txinput_setup(rt,in,fn)) return false;
+			while(rt.read_line()) {
+				int32_t addr, cl;
+				if(!(rt.read_int32(addr) && rt.read_int32(cl))) break;
+				uint32_t i = (uint32_t)((int64_t)addr + 1);
+				uint32_t r = (uint32_t)((int64_t)cl + 1);
+				add_node(r);
+				parent1(i) = r + 1;
+			}
+			if(rt.get_last_error() != T_EOF) {
+				fprintf(stderr,"addr_clusters: ");
+				rt.write_error(stderr);
+				return false;
+			}
+			flatten();
+			return true;
+		}
+};
+
+
+/* column layout of an input file: (0-based) index of the columns
+ * containing the transaction ID, the address and the value; any other
+ * columns are skipped without parsing them */
+struct txr_cols {
+	unsigned int txid;
+	unsigned int addr;
+	unsigned int value;
+	
+	static const unsigned int max_col = 255; // largest column index accepted by parse()
+	
+	/* parse a column specification in the format "txid,addr,value"
+	 * (indices are between 0 and max_col); return true if successful */
+	bool parse(const char* str) {
+		long c[3];
+		const char* p = str;
+		for(int i=0;i<3;i++) {
+			if(i) {
+				if(*p != ',') return false;
+				p++;
+			}
+			if(*p < '0' || *p > '9') return false; // no sign or whitespace
+			char* end;
+			c[i] = strtol(p,&end,10);
+			if(c[i] > (long)max_col) return false;
+			p = end;
+		}
+		if(*p) return false;
+		if(c[0] == c[1] || c[0] == c[2] || c[1] == c[2]) return false;
+		txid = c[0];
+		addr = c[1];
+		value = c[2];
+		return true;
+	}
+};
+
+/* default layouts: txin has txid, input_seq, prev_txid, prev_output_seq,
+ * addr, sum; the old version of txin and txout have txid, seq, addr, sum */
+static const txr_cols txin_cols = {0,4,5};
+static const txr_cols txin_cols_old = {0,2,3};
+static const txr_cols txout_cols = {0,2,3};
+
 
 class txr_it {
 	protected:
 		read_table2 rt;
 		const char* fn;
 		txrecord r;
-		int cskip;
+		std::vector<uint8_t> col_types; // type of each column to read, see below
 		bool is_end_;
 		uint64_t lines_max;
 		uint64_t header_skip;
+		uint32_t txid_min; // range of transactions to read (see set_range())
+		uint64_t txid_end;
 		//~ txr_it() = delete;
 		
+		// reading and parsing in a separate thread (see start_thread())
+		spsc_queue<std::vector<txrecord> >* q;
+		std::thread reader;
+		std::vector<txrecord> batch; // current batch of records received from the reader thread
+		size_t batch_pos;
+		bool reader_error; // set by the reader thread if there was an error
+		size_t inline_batch; // if > 0, records are read in batches of this size in the current thread (see start_batches())
+		bool input_done; // end of input reached when reading batches in the current thread
+		
+		// progress: number of records and position in the input file, updated
+		// regularly by the thread reading the input (see update_progress())
+		const zinput* z;
+		uint64_t nrec;
+		std::atomic<uint64_t> nrec_progress;
+		std::atomic<uint64_t> pos_progress;
+		
+		enum col_type : uint8_t { col_skip = 0, col_txid, col_addr, col_value };
+		
+		// read next record from input into rec
+		// return: 0 -- OK, 1 -- end of input, -1 -- error
+		int read_record(txrecord& rec) {
+			bool skip = true;
+			while(skip) {
+				if(!rt.read_line()) {
+					if(rt.get_last_error() != T_EOF) return -1;
+					return 1;
+				}
+				skip = false;
+				for(uint8_t t : col_types) {
+					switch(t) {
+						case col_txid:
+							if(!rt.read_uint32(rec.txid)) return -1;
+							// stop at the end of the selected range (input is sorted by txid),
+							// skip the rest of the line before the start of the range
+							if(rec.txid >= txid_end) return 1;
+							if(rec.txid < txid_min) skip = true;
+							break;
+						case col_addr:
+							// read address -- only -1 is accepted as "unknown" address, other negative values are an error
+							if(!rt.read_int32_limits(rec.addr,-1,INT32_MAX)) return -1;
+							break;
+						case col_value:
+							if(!rt.read_int64(rec.value)) return -1;
+							break;
+						default:
+							// skip columns not needed without parsing them
+							if(!rt.read_skip()) return -1;
+							break;
+					}
+					if(skip) break;
+				}
+			}
+			if(!(++nrec & 4095)) update_progress();
+			return 0;
+		}
+		
+		void update_progress() {
+			nrec_progress.store(nrec,std::memory_order_relaxed);
+			int64_t pos = z ? (int64_t)z->in_pos() : rt.get_offset();
+			if(pos >= 0) pos_progress.store(pos,std::memory_order_relaxed);
+		}
+		
 		// read next record from input
 		int read_next() {
-			if(!rt.read_line()) {
-				if(rt.get_last_error() != T_EOF) return -1;
+			int ret = read_record(r);
+			if(ret == 1) {
 				is_end_ = true;
+				update_progress();
+			}
+			return ret < 0 ? -1 : 0;
+		}
+		
+		// read records in batches and pass them to the main thread
+		void reader_thread(size_t batch_size) {
+			int ret = 0;
+			while(!ret) {
+				std::vector<txrecord> b;
+				b.reserve(batch_size);
+				txrecord rec;
+				{
+					txedge_timer t(stage_parse);
+					while(b.size() < batch_size) {
+						ret = read_record(rec);
+						if(ret) break;
+						b.push_back(rec);
+					}
+				}
+				if(b.size() && !q->push(std::move(b))) return; // cancelled
+			}
+			update_progress();
+			reader_error = (ret < 0);
+			q->close();
+		}
+		
+		// get the next record from the reader thread
+		int next_from_thread() {
+			if(++batch_pos < batch.size()) {
+				r = batch[batch_pos];
+				return 0;
+			}
+			if(q->pop(batch)) {
+				// note: batches are never empty
+				batch_pos = 0;
+				r = batch[0];
+				return 0;
+			}
+			reader.join();
+			if(reader_error) return -1;
+			is_end_ = true;
+			return 0;
+		}
+		
+		// get the next record from a batch read in the current thread
+		// (only used to measure the time spent parsing more precisely)
+		int next_from_batch() {
+			if(++batch_pos < batch.size()) {
+				r = batch[batch_pos];
+				return 0;
+			}
+			batch.clear();
+			batch_pos = 0;
+			if(!input_done) {
+				txedge_timer t(stage_parse);
+				txrecord rec;
+				while(batch.size() < inline_batch) {
+					int ret = read_record(rec);
+					if(ret) {
+						input_done = true;
+						reader_error = (ret < 0);
+						update_progress();
+						break;
+					}
+					batch.push_back(rec);
+				}
+			}
+			if(batch.size()) {
+				r = batch[0];
 				return 0;
 			}
-			// first col: txid
-			if(!rt.read_uint32(r.txid)) return -1;
-			// skip cskip columns
-			for(int i=0;i<cskip;i++) {
-				int64_t tmp;
-				if(!rt.read_int64(tmp)) return -1;
-			}
-			// read address -- only -1 is accepted as "unknown" address, other negative values are an error
-			if(!rt.read_int32_limits(r.addr,-1,INT32_MAX)) return -1;
-			// read value
-			if(!rt.read_int64(r.value)) return -1;
+			if(reader_error) return -1;
+			is_end_ = true;
 			return 0;
 		}
 		// write error message and throw exception
@@ -86,17 +740,76 @@ class txr_it {
 		}
 		
 	public:
-		txr_it(FILE* in_, int cskip_, const char* fn_ = 0, uint64_t header_skip_ = 0, uint64_t lines_max_ = 0):rt(in_) {
+		txr_it(const txinput& in_, const txr_cols& cols, const char* fn_ = 0, uint64_t header_skip_ = 0, uint64_t lines_max_ = 0):rt(in_.f) {
 			fn = fn_;
+			z = in_.z;
+			nrec = 0;
+			nrec_progress = 0;
+			pos_progress = 0;
+			inline_batch = 0;
+			input_done = false;
 			header_skip = header_skip_;
 			lines_max = lines_max_;
-			cskip = cskip_;
+			txid_min = 0;
+			txid_end = ((uint64_t)UINT32_MAX) + 1;
+			size_t ncols = ((size_t)std::max(cols.txid,std::max(cols.addr,cols.value))) + 1;
+			col_types.assign(ncols,col_skip);
+			col_types[cols.txid] = col_txid;
+			col_types[cols.addr] = col_addr;
+			col_types[cols.value] = col_value;
+			if(!txinput_setup(rt,in_,fn)) throw new std::runtime_error("txr_it: error allocating memory!\n");
 			// read and ignore exactly the given number of header lines
 			for(uint64_t j=0;j<header_skip;j++) rt.read_line(false);
 			is_end_ = false;
+			q = 0;
+			batch_pos = 0;
+			reader_error = false;
 			if(read_next()) handle_error();
+			update_progress();
+		}
+		
+		~txr_it() {
+			if(q) {
+				q->close(); // stops the reader thread if it is still running
+				if(reader.joinable()) reader.join();
+				delete q;
+			}
+		}
+		
+		// only read transactions with txid_min_ <= txid < txid_end_, records
+		// before are skipped, and reading stops after the end of the range;
+		// should be called before start_thread()
+		void set_range(uint32_t txid_min_, uint64_t txid_end_) {
+			if(q) return;
+			txid_min = txid_min_;
+			txid_end = txid_end_;
+			while(!is_end_ && r.txid < txid_min) if(read_next()) handle_error();
+			if(!is_end_ && r.txid >= txid_end) is_end_ = true;
+		}
+		
+		// start reading and parsing the input in a separate thread,
+		// passing records in batches of the given size
+		void start_thread(size_t batch_size = 65536, size_t queue_size = 16) {
+			if(q || is_end_) return;
+			q = new spsc_queue<std::vector<txrecord> >(queue_size);
+			reader = std::thread(&txr_it::reader_thread,this,batch_size);
+		}
+		
+		// read records in batches of the given size in the current thread
+		// (instead of one by one), so that the time spent parsing can be
+		// measured with less overhead; should be called before
+		// start_thread() or reading anything
+		void start_batches(size_t batch_size = 4096) {
+			if(q || is_end_) return;
+			inline_batch = batch_size;
 		}
 		
+		// number of records read so far and the position in the input file
+		// (for compressed files, in the compressed data); these are only
+		// updated after every 4096 records and can be read from any thread
+		uint64_t records_read() const { return nrec_progress.load(std::memory_order_relaxed); }
+		uint64_t bytes_read() const { return pos_progress.load(std::memory_order_relaxed); }
+		
 		
 		txrecord operator *() const {
 			if(is_end_) throw new std::runtime_error("txr_it(): iterator used after reaching the end!\n");
@@ -107,7 +820,7 @@ class txr_it {
 			return &r;
 		}
 		void operator++() {
-			if(read_next()) handle_error();
+			if(q ? next_from_thread() : (inline_batch ? next_from_batch() : read_next())) handle_error();
 		}
 		
 		bool is_end() const {
@@ -116,37 +829,41 @@ class txr_it {
 };
 
 
-class tx {
+/* iterate over records stored in memory (used when processing chunks of
+ * transactions in parallel), same interface as txr_it */
+class txr_vec_it {
+	protected:
+		const txrecord* p;
+		const txrecord* end;
+	public:
+		explicit txr_vec_it(const std::vector<txrecord>& v):p(v.data()),end(v.data() + v.size()) { }
+		txrecord operator *() const { return *p; }
+		const txrecord* operator ->() const { return p; }
+		void operator++() { p++; }
+		bool is_end() const { return p == end; }
+};
+
+
+/* join inputs and outputs of transactions read from txr (either txr_it
+ * or txr_vec_it) */
+template<class txr>
+class tx_t {
 	protected:
 		std::vector<std::pair<int,int64_t> > inputs;
 		std::vector<std::pair<int,int64_t> > outputs;
 		unsigned int txid;
-		txr_it& in;
-		txr_it& out;
+		txr& in;
+		txr& out;
+		std::vector<txrecord>* skipped; // if not null, outputs skipped (without inputs) are stored here
+		addr_map* remap; // if not null, addresses are renumbered with this
+		const addr_clusters* clusters; // if not null, addresses are replaced by their cluster IDs
+		const tx_times* window; // if not null, transactions without a timestamp in this are skipped
+		std::vector<std::pair<int,int64_t> > tmp; // temporary storage for tx_compress()
 		//~ tx() = delete;
 		
-		static void vector_compress(std::vector<std::pair<int,int64_t> >& vec) {
-			std::sort(vec.begin(),vec.end(),[](const auto& a, const auto& b) { return a.first < b.first; });
-			
-			size_t i=0;
-			for(size_t j=1;j<vec.size();j++) {
-				if(vec[i].first == vec[j].first) vec[i].second += vec[j].second;
-				else {
-					i++;
-					if(i != j) vec[i] = vec[j];
-				}
-			}
-			vec.erase(vec.begin()+i+1,vec.end());
-		}
-		
-	public:
-		tx(txr_it& txin_, txr_it& txout_):in(txin_),out(txout_) { }
-		
-		/* read next transaction (both inputs and outputs)
-		 * return: true -- OK, false -- end of files
-		 * throws exception on format error (from txr_it::operator++())
-		 */
-		bool read_next() {
+		/* read the inputs and outputs of the next transaction, without
+		 * any further processing; return false at the end of files */
+		bool read_next_tx() {
 			if(in.is_end() || out.is_end()) return false;
 			
 			inputs.clear();
@@ -160,7 +877,10 @@ class tx {
 			}
 			
 			// check that txout matches or advance it
-			for(;!out.is_end();++out) if(out->txid >= txid) break;
+			for(;!out.is_end();++out) {
+				if(out->txid >= txid) break;
+				if(skipped) skipped->push_back(*out);
+			}
 			
 			if(out.is_end()) {
 				// no outputs for the current transaction
@@ -178,7 +898,7 @@ class tx {
 					}
 				}
 				// recursively try to find the inputs of the this transaction
-				return read_next();
+				return read_next_tx();
 			}
 			
 			// add transaction outputs
@@ -186,12 +906,59 @@ class tx {
 				if(out->txid != txid) break;
 				outputs.push_back(std::make_pair(out->addr,out->value));
 			}
-			
+			return true;
+		}
+		
+	public:
+		tx_t(txr& txin_, txr& txout_):in(txin_),out(txout_),skipped(0),remap(0),clusters(0),window(0) { }
+		
+		/* replace addresses by their cluster IDs (before renumbering them if
+		 * set_remap() is used as well); clusters_ should be flattened */
+		void set_clusters(const addr_clusters* clusters_) { clusters = clusters_; }
+		
+		/* renumber addresses of transactions read using the given table
+		 * (inputs first, then outputs, in the order of the records) */
+		void set_remap(addr_map* remap_) { remap = remap_; }
+		
+		/* store outputs of transactions without inputs (i.e. mining
+		 * transactions) in the given vector as they are skipped */
+		void set_skipped(std::vector<txrecord>* skipped_) { skipped = skipped_; }
+		
+		/* skip transactions without a timestamp in window_ (i.e. outside
+		 * the time window it was read with); these are skipped before
+		 * replacing and renumbering addresses */
+		void set_window(const tx_times* window_) { window = window_; }
+		
+		/* add all remaining outputs to the skipped ones (after read_next()
+		 * returned false, i.e. there are no more inputs) */
+		void drain_outputs() {
+			if(!skipped) return;
+			for(;!out.is_end();++out) skipped->push_back(*out);
+		}
+		
+		/* read next transaction (both inputs and outputs)
+		 * return: true -- OK, false -- end of files
+		 * throws exception on format error (from txr_it::operator++())
+		 */
+		bool read_next() {
+			txedge_timer tm(stage_join);
+			do {
+				if(!read_next_tx()) return false;
+			} while(window && window->get(txid) == 0);
 			
 			// now we have a valid transaction with >0 inputs and outputs
+			if(clusters) {
+				for(auto& x : inputs) x.first = clusters->lookup(x.first);
+				for(auto& x : outputs) x.first = clusters->lookup(x.first);
+			}
+			if(remap) {
+				for(auto& x : inputs) x.first = remap->map(x.first);
+				for(auto& x : outputs) x.first = remap->map(x.first);
+			}
 			// sort inputs and outputs, merge if an address appears more than once
-			vector_compress(inputs);
-			vector_compress(outputs);
+			// (vectors are reused, so no memory is allocated after the first few transactions)
+			tx_compress(inputs,tmp);
+			tx_compress(outputs,tmp);
 			return true;
 		}
 		
@@ -237,7 +1004,7 @@ class tx {
 					return &e;
 				}
 				
-				iterator(const tx* t):inputs(t->inputs),outputs(t->outputs),txid(t->txid) {
+				iterator(const tx_t* t):inputs(t->inputs),outputs(t->outputs),txid(t->txid) {
 					in_it = inputs.cbegin();
 					out_it = outputs.cbegin();
 					int64_t tmp = 0;
@@ -250,105 +1017,1643 @@ class tx {
 		};
 		
 		iterator get_iterator() const { return iterator(this); }
+		
+		/* append the edges of the current transaction from inputs i0 <= i < i1
+		 * to b (in the same order and with the same weights as given by the
+		 * iterator); returns the number of edges */
+		size_t get_edges(tx_batch& b, size_t i0 = 0, size_t i1 = SIZE_MAX) const {
+			i1 = std::min(i1,inputs.size());
+			if(i0 >= i1) return 0;
+			size_t n = i1 - i0;
+			size_t m = outputs.size();
+			size_t k = b.size();
+			size_t e = n*m;
+			b.txid.resize(k + e,txid);
+			b.addr_in.resize(k + e);
+			b.addr_out.resize(k + e);
+			b.w.resize(k + e);
+			for(size_t i=0;i<n;i++) {
+				std::fill_n(b.addr_in.begin() + (k + i*m),m,inputs[i0 + i].first);
+				for(size_t j=0;j<m;j++) b.addr_out[k + i*m + j] = outputs[j].first;
+			}
+			int64_t tmp = 0;
+			for(const auto& x : inputs) tmp += x.second;
+			double sum = (double)tmp;
+			if(sum > 0.0) {
+				b.in_values.resize(n);
+				b.out_ratios.resize(m);
+				for(size_t i=0;i<n;i++) b.in_values[i] = (double)inputs[i0 + i].second;
+				for(size_t j=0;j<m;j++) b.out_ratios[j] = ((double)outputs[j].second) / sum;
+				tx_weights_kernel(b.in_values.data(),n,b.out_ratios.data(),m,b.w.data() + k);
+			}
+			else std::fill_n(b.w.begin() + k,e,0.0);
+			return e;
+		}
+		
+		/* number of inputs to give to get_edges() at once, so that at most
+		 * about max_edges edges are stored in a batch (at least one input,
+		 * i.e. all outputs, is needed) */
+		size_t batch_inputs(size_t max_edges = tx_batch_max_edges) const {
+			size_t m = outputs.size();
+			return (m && max_edges > m) ? max_edges / m : 1;
+		}
+		unsigned int get_txid() const { return txid; }
+		// (compressed) inputs and outputs of the current transaction
+		const std::vector<std::pair<int,int64_t> >& get_inputs() const { return inputs; }
+		const std::vector<std::pair<int,int64_t> >& get_outputs() const { return outputs; }
 };
 
+typedef tx_t<txr_it> tx;
 
-const char gzip[] = "/bin/gzip -cd";
-const char xz[] = "/usr/bin/xz -cd";
 
+/* format one edge as a line of text (txid, addr_in, addr_out, weight)
+ * the weight is formatted as with printf("%.17g"), or in the shortest
+ * form that reads back as the same value if shortest == true
+ * if ts >= 0, it is written as a timestamp after the txid
+ * p should have space for at least 64 characters, returns a pointer after
+ * the line written */
+static inline char* format_edge(char* p, const txedge& e, bool shortest, int64_t ts = -1) {
+	p = format_uint32(p,e.txid);
+	*p++ = '\t';
+	if(ts >= 0) {
+		p = format_int64(p,ts);
+		*p++ = '\t';
+	}
+	p = format_int32(p,e.addr_in);
+	*p++ = '\t';
+	p = format_int32(p,e.addr_out);
+	*p++ = '\t';
+	p = shortest ? format_double_short(p,e.w) : format_double17(p,e.w);
+	*p++ = '\n';
+	return p;
+}
 
-FILE* open_pipe(const char* fn, const char* pr) {
-	FILE* f = 0;
-	char* tmp = (char*)malloc(sizeof(char)*(strlen(fn) + strlen(pr) + 4));
-	if(!tmp) { fprintf(stderr,"open_pipe(): error allocating memory!\n"); return 0; }
-	sprintf(tmp,"%s %s",pr,fn);
-	f = popen(tmp,"r");
-	if(!f) fprintf(stderr,"open_pipe(): error running command: %s\n",tmp);
-	free(tmp);
-	return f;
+/* output formats: TSV (with weights as %.17g or in the shortest form),
+ * binary (see txedge_bin.h) or columnar (see txedge_col.h) */
+enum out_format { out_tsv, out_tsv_short, out_bin, out_col };
+
+/* write one edge to o (buf_writer or mem_buf) in one of the record-based
+ * formats (not out_col); ts is the timestamp (-1 if not written) */
+template<class out_buf>
+static inline void write_edge(out_buf& o, const txedge& e, out_format fmt, int64_t ts) {
+	if(fmt == out_bin) {
+		char* p = o.reserve(txedge_bin_record_size);
+		txedge_bin_encode(p,e.txid,e.addr_in,e.addr_out,e.w,ts >= 0 ? (uint32_t)ts : 0);
+		o.commit(txedge_bin_record_size);
+	}
+	else {
+		char* p = o.reserve(96);
+		o.commit(format_edge(p,e,fmt == out_tsv_short,ts) - p);
+	}
 }
 
-FILE* open_input(const char* fn, bool pgz, bool pxz) {
-	if(pxz) return open_pipe(fn,xz);
-	if(pgz) return open_pipe(fn,gzip);
-	FILE* f = fopen(fn,"r");
-	if(!f) fprintf(stderr,"open_input(): error opening file: %s\n",fn);
-	return f;
+/* write all edges in b to o (buf_writer or mem_buf) in one of the
+ * record-based formats (not out_col); ts is the timestamp (-1 if not
+ * written); space is reserved for blocks of edges at once */
+template<class out_buf>
+static void write_batch(out_buf& o, const tx_batch& b, out_format fmt, int64_t ts) {
+	const size_t block = 4096;
+	bool shortest = (fmt == out_tsv_short);
+	uint32_t ts2 = ts >= 0 ? (uint32_t)ts : 0;
+	for(size_t k=0;k<b.size();k+=block) {
+		size_t end = std::min(b.size(),k + block);
+		if(fmt == out_bin) {
+			char* p = o.reserve(txedge_bin_record_size*(end - k));
+			for(size_t i=k;i<end;i++,p+=txedge_bin_record_size)
+				txedge_bin_encode(p,b.txid[i],b.addr_in[i],b.addr_out[i],b.w[i],ts2);
+			o.commit(txedge_bin_record_size*(end - k));
+		}
+		else {
+			char* p0 = o.reserve(96*(end - k));
+			char* p = p0;
+			for(size_t i=k;i<end;i++) {
+				p = format_uint32(p,b.txid[i]);
+				*p++ = '\t';
+				if(ts >= 0) {
+					p = format_int64(p,ts);
+					*p++ = '\t';
+				}
+				p = format_int32(p,b.addr_in[i]);
+				*p++ = '\t';
+				p = format_int32(p,b.addr_out[i]);
+				*p++ = '\t';
+				p = shortest ? format_double_short(p,b.w[i]) : format_double17(p,b.w[i]);
+				*p++ = '\n';
+			}
+			o.commit(p - p0);
+		}
+	}
 }
 
+/* special address denoting the transaction itself in the bipartite
+ * representation (not a valid address in the input) */
+static const int tx_node = -2;
 
-int main(int argc, char **argv)
-{
-	char* txin = 0;
-	char* txout = 0;
+/* write all edges of the current transaction to o (buf_writer or mem_buf)
+ * in one of the record-based formats (not out_col)
+ * if bipartite == true, N + M edges are written instead of N x M:
+ * input address -> transaction (tx_node) and transaction -> output address;
+ * weights of input edges are scaled by total output / total input, so that
+ * they include the proportional share of fees as in the NxM representation
+ * ts is the timestamp of the transaction to include (-1 if not written)
+ * b is used as temporary storage for the N x M edges
+ * returns the number of edges written */
+template<class txr, class out_buf>
+static uint64_t write_tx_edges(const tx_t<txr>& t, out_buf& o, out_format fmt, tx_batch& b, bool bipartite = false, int64_t ts = -1) {
+	if(bipartite) {
+		txedge_timer tm(stage_format);
+		const auto& inputs = t.get_inputs();
+		const auto& outputs = t.get_outputs();
+		if(inputs.empty() || outputs.empty()) return 0;
+		int64_t tmp = 0;
+		for(const auto& x : inputs) tmp += x.second;
+		double sum_in = (double)tmp;
+		tmp = 0;
+		for(const auto& x : outputs) tmp += x.second;
+		double sum_out = (double)tmp;
+		txedge e;
+		e.txid = t.get_txid();
+		e.addr_out = tx_node;
+		for(const auto& x : inputs) {
+			e.addr_in = x.first;
+			if(sum_in > 0.0) e.w = ((double)(x.second)) * (sum_out / sum_in);
+			else e.w = 0.0;
+			write_edge(o,e,fmt,ts);
+		}
+		e.addr_in = tx_node;
+		for(const auto& x : outputs) {
+			e.addr_out = x.first;
+			// note: output edges are zero if there are no inputs with value
+			// (as in the NxM representation)
+			e.w = (sum_in > 0.0) ? (double)(x.second) : 0.0;
+			write_edge(o,e,fmt,ts);
+		}
+		return inputs.size() + outputs.size();
+	}
+	// edges are created and written in batches of inputs, so large
+	// transactions do not need memory for all of their edges at once
+	uint64_t e = 0;
+	size_t n = t.get_inputs().size();
+	size_t rows = t.batch_inputs();
+	for(size_t i=0;i<n;i+=rows) {
+		{
+			txedge_timer tm(stage_weight);
+			b.clear();
+			t.get_edges(b,i,i + rows);
+		}
+		txedge_timer tm(stage_format);
+		write_batch(o,b,fmt,ts);
+		e += b.size();
+	}
+	return e;
+}
+
+/* write the edges of a sequence of transactions in any format, keeping
+ * track of the number of transactions and edges written; used once for the
+ * whole output or for each chunk when processing in parallel */
+struct edge_writer {
+	out_format fmt;
+	uint64_t bipartite_min; // use the bipartite representation for transactions with more than this many edges
+	txedge_col_encoder col; // for columnar output
+	const tx_times* times; // if not null, timestamps are included in the output
+	bool ts_window; // if true, transactions without a timestamp (outside the time window) are skipped
+	std::vector<txedge_col_chunk_info> col_idx; // columnar chunks written
+	uint64_t pos; // bytes written so far (only counted for columnar output)
+	uint64_t txs;
+	uint64_t edges;
+	unsigned int min_txid; // first and last transaction with edges
+	unsigned int max_txid;
+	uint64_t no_ts; // transactions without a known timestamp
+	uint64_t mining; // outputs of mining transactions written (see add_mining())
+	bool aggregate; // if true, edges are collected in agg_edges instead of writing them
+	bool agg_loops; // if false, self-loops are not included in agg_edges
+	std::vector<pair_agg_rec> agg_edges;
+	pair_agg* agg; // if not null, edges are added to this directly instead of agg_edges (when processing sequentially)
+	tx_batch batch; // temporary storage for the edges of a transaction
 	
-	bool in_gz = false;
-	bool in_xz = false;
-	bool out_gz = false;
-	bool out_xz = false;
+	explicit edge_writer(out_format fmt_, uint64_t bipartite_min_ = UINT64_MAX,
+			const txedge_col_encoder& col_ = txedge_col_encoder()):
+		fmt(fmt_),bipartite_min(bipartite_min_),col(col_),times(0),ts_window(false),pos(0),txs(0),edges(0),min_txid(0),max_txid(0),no_ts(0),mining(0),
+		aggregate(false),agg_loops(true),agg(0) { }
 	
-	bool old_format = false;
+	/* a new instance with the same settings (without any data written) */
+	edge_writer copy_settings() const {
+		edge_writer ew(fmt,bipartite_min,col);
+		ew.times = times;
+		ew.ts_window = ts_window;
+		ew.aggregate = aggregate;
+		ew.agg_loops = agg_loops;
+		return ew;
+	}
 	
-	for(int i=1;i<argc;i++) if(argv[i][0] == '-') switch(argv[i][1]) {
-		case 'i':
-			txin = argv[i+1];
-			if(argv[i][2] == 'x') in_xz = true;
-			if(argv[i][2] == 'z') in_gz = true;
-			i++;
-			break;
-		case 'o':
-			txout = argv[i+1];
-			if(argv[i][2] == 'x') out_xz = true;
-			if(argv[i][2] == 'z') out_gz = true;
-			i++;
-			break;
-		case '1':
-			old_format = true;
-			break;
-		default:
-			fprintf(stderr,"Unknown command line argument: %s!\n",argv[i]);
-			break;
+	/* add the edges collected so far to agg_ (if aggregating); returns
+	 * false if there was an error in agg_ */
+	bool flush_agg(pair_agg& agg_) {
+		bool ret = !agg_.has_error();
+		for(const pair_agg_rec& r : agg_edges) {
+			if(!ret) break;
+			if(!agg_.add(r.addr_in,r.addr_out,r.w,r.first_txid)) ret = false;
+		}
+		agg_edges.clear();
+		return ret;
 	}
 	
-	if( !(txin && txout) ) {
-		fprintf(stderr,"Error: missing input file names!\n");
-		return 1;
+	template<class txr, class out_buf>
+	void add(const tx_t<txr>& t, out_buf& o) {
+		uint64_t e;
+		int64_t ts = times ? (int64_t)times->get(t.get_txid()) : -1;
+		if(ts == 0) {
+			if(ts_window) return;
+			no_ts++;
+		}
+		txs++;
+		if(aggregate) {
+			txedge_timer tm(stage_weight);
+			e = 0;
+			size_t n = t.get_inputs().size();
+			size_t rows = t.batch_inputs();
+			for(size_t j=0;j<n;j+=rows) {
+				batch.clear();
+				size_t e1 = t.get_edges(batch,j,j + rows);
+				e += e1;
+				for(size_t i=0;i<e1;i++) if(agg_loops || batch.addr_in[i] != batch.addr_out[i]) {
+					// errors in agg are checked by flush_agg()
+					if(agg) agg->add(batch.addr_in[i],batch.addr_out[i],batch.w[i],batch.txid[i]);
+					else agg_edges.push_back(pair_agg_rec{batch.addr_in[i],batch.addr_out[i],batch.txid[i],batch.txid[i],1,batch.w[i]});
+				}
+			}
+		}
+		else if(fmt == out_col) {
+			txedge_timer tm(stage_format);
+			e = col.add_tx(t.get_txid(),t.get_inputs(),t.get_outputs(),ts >= 0 ? (uint32_t)ts : 0);
+			if(col.chunk_full()) col.finish_chunk(o,col_idx,pos);
+		}
+		else {
+			uint64_t n = ((uint64_t)t.get_inputs().size()) * ((uint64_t)t.get_outputs().size());
+			e = write_tx_edges(t,o,fmt,batch,n > bipartite_min,ts);
+		}
+		if(e) {
+			if(!edges) min_txid = t.get_txid();
+			max_txid = t.get_txid();
+			edges += e;
+		}
 	}
-	FILE* in = 0;
-	FILE* out = 0;
 	
-	// open transaction inputs file
-	in = open_input(txin,in_gz,in_xz);
-	out = open_input(txout,out_gz,out_xz);
+	/* write outputs of mining transactions (i.e. transactions without
+	 * inputs) to o as TSV (txid, [timestamp,] address, value); outputs
+	 * outside the time window are skipped if one is used */
+	template<class out_buf>
+	void add_mining(const std::vector<txrecord>& outs, out_buf& o) {
+		for(const txrecord& r : outs) {
+			int64_t ts = times ? (int64_t)times->get(r.txid) : -1;
+			if(ts == 0 && ts_window) continue;
+			char* p = o.reserve(96);
+			char* p0 = p;
+			p = format_uint32(p,r.txid);
+			*p++ = '\t';
+			if(ts >= 0) {
+				p = format_int64(p,ts);
+				*p++ = '\t';
+			}
+			p = format_int32(p,r.addr);
+			*p++ = '\t';
+			p = format_int64(p,r.value);
+			*p++ = '\n';
+			o.commit(p - p0);
+			mining++;
+		}
+	}
+	
+	/* write out any remaining data (the last columnar chunk) */
+	template<class out_buf>
+	void finish(out_buf& o) {
+		if(fmt == out_col) col.finish_chunk(o,col_idx,pos);
+	}
 	
-	if(in && out) {
-		txr_it in_it(in,old_format?1:3,txin);
-		txr_it out_it(out,1,txout);
+	/* add the totals from the output of a chunk written after this one */
+	void append(const edge_writer& c) {
+		txs += c.txs;
+		no_ts += c.no_ts;
+		mining += c.mining;
+		if(c.edges) {
+			if(!edges) min_txid = c.min_txid;
+			max_txid = c.max_txid;
+			edges += c.edges;
+		}
+		for(txedge_col_chunk_info i : c.col_idx) {
+			i.offset += pos;
+			col_idx.push_back(i);
+		}
+		pos += c.pos;
+	}
+};
+
+
+/* partitioned output: the edges of each transaction are written to a
+ * separate file for each day or month (based on the timestamp of the
+ * transaction); since transactions are processed in order, usually only
+ * a few files are written at the same time, but block timestamps are not
+ * strictly increasing, so a limited number of files are kept open, and
+ * files are closed (and reopened later if needed) as necessary */
+class part_output {
+	public:
+		enum period_type { day, month };
+		
+	protected:
+		struct part {
+			std::string fn;
+			int fd; // -1 if not open
+			buf_writer* w;
+			edge_writer ew;
+			uint64_t last_use;
+			explicit part(const edge_writer& ew_):fd(-1),w(0),ew(ew_),last_use(0) { }
+		};
+		
+		edge_writer ew0; // output format and settings
+		std::string prefix; // output file names are prefix + period + extension
+		period_type pt;
+		size_t max_open; // maximum number of files kept open
+		size_t nopen;
+		uint64_t use_cnt;
+		std::map<uint32_t,part> parts;
+		bool error;
+		
+		const char* extension() const {
+			switch(ew0.fmt) {
+				case out_bin: return ".bin";
+				case out_col: return ".col";
+				default: return ".dat";
+			}
+		}
+		
+		std::string period_name(uint32_t period) const {
+			char tmp[32];
+			if(pt == day) {
+				time_t t = ((time_t)period) * 86400;
+				struct tm tm;
+				gmtime_r(&t,&tm);
+				strftime(tmp,32,"%Y-%m-%d",&tm);
+			}
+			else snprintf(tmp,32,"%04u-%02u",period / 12,period % 12 + 1);
+			return std::string(tmp);
+		}
+		
+		void close_part(part& p) {
+			if(p.fd < 0) return;
+			p.ew.finish(*p.w); // note: flushes the last columnar chunk
+			p.w->close();
+			if(p.w->has_error()) error = true;
+			delete p.w;
+			p.w = 0;
+			::close(p.fd);
+			p.fd = -1;
+			nopen--;
+		}
+		
+		// get the output file for the given period, opening it if needed
+		part& get_part(uint32_t period) {
+			auto it = parts.find(period);
+			bool is_new = (it == parts.end());
+			if(is_new) {
+				it = parts.emplace(period,part(ew0)).first;
+				it->second.fn = prefix + period_name(period) + extension();
+			}
+			part& p = it->second;
+			p.last_use = use_cnt++;
+			if(p.fd >= 0) return p;
+			
+			if(nopen >= max_open) {
+				// close the least recently used file
+				part* lru = 0;
+				for(auto& x : parts) if(x.second.fd >= 0 && (!lru || x.second.last_use < lru->last_use)) lru = &(x.second);
+				if(lru) close_part(*lru);
+			}
+			p.fd = open(p.fn.c_str(),O_WRONLY | O_CREAT | (is_new ? O_TRUNC : O_APPEND),0666);
+			if(p.fd < 0) {
+				fprintf(stderr,"part_output: error opening output file %s!\n",p.fn.c_str());
+				throw new std::runtime_error("part_output: error opening output file!\n");
+			}
+			nopen++;
+			p.w = new buf_writer(p.fd,1U << 20);
+			if(is_new) {
+				// headers of the binary and columnar formats
+				if(ew0.fmt == out_bin) {
+					txedge_bin_header h = {txedge_bin_version,UINT64_MAX,0,0,ew0.times ? TXEDGE_BIN_FLAG_TS : 0};
+					txedge_bin_encode_header(p.w->reserve(txedge_bin_header_size),h);
+					p.w->commit(txedge_bin_header_size);
+				}
+				if(ew0.fmt == out_col) {
+					p.ew.col.write_header(*(p.w));
+					p.ew.pos = txedge_col_header_size;
+				}
+			}
+			return p;
+		}
+		
+	public:
+		/* ew: output format and settings (timestamps are required)
+		 * prefix_: beginning of the output file names (directory and / or
+		 * file name prefix), the period (as YYYY-MM-DD or YYYY-MM) and an
+		 * extension based on the format are appended to it */
+		part_output(const edge_writer& ew, const char* prefix_, period_type pt_, size_t max_open_ = 64):
+			ew0(ew.copy_settings()),prefix(prefix_),pt(pt_),max_open(max_open_ ? max_open_ : 1),nopen(0),use_cnt(0),error(false) { }
+		~part_output() { finish(); }
 		
-		tx tx_it(in_it,out_it);
-		uint64_t txs = 0;
-		uint64_t edges = 0;
+		/* get the period of the given transaction; returns false if it has
+		 * no timestamp (i.e. it is outside the time window if one is used) */
+		bool get_period(uint32_t txid, uint32_t& period) const {
+			uint32_t ts = ew0.times->get(txid);
+			if(!ts) return false;
+			if(pt == day) period = ts / 86400;
+			else {
+				time_t t = ts;
+				struct tm tm;
+				gmtime_r(&t,&tm);
+				period = (uint32_t)(tm.tm_year + 1900) * 12 + (uint32_t)tm.tm_mon;
+			}
+			return true;
+		}
+		
+		/* write the edges of one transaction to the file of its period;
+		 * returns false if it has no timestamp (nothing is written) */
+		template<class txr>
+		bool add(const tx_t<txr>& t) {
+			uint32_t period;
+			if(!get_period(t.get_txid(),period)) return false;
+			part& p = get_part(period);
+			p.ew.add(t,*(p.w));
+			return true;
+		}
+		
+		/* write data formatted separately for the given period (when
+		 * processing in parallel, see tx_parallel) */
+		void add_chunk(uint32_t period, const mem_buf& data, const edge_writer& ew) {
+			part& p = get_part(period);
+			p.w->write(data.data.data(),data.len);
+			p.ew.append(ew);
+		}
+		
+		/* finish writing all files (writes the columnar index or updates
+		 * the binary headers), add the number of transactions and edges to
+		 * totals; returns false if there was an error */
+		bool finish(edge_writer* totals = 0) {
+			for(auto& x : parts) {
+				part& p = x.second;
+				if(ew0.fmt == out_col) {
+					get_part(x.first);
+					p.ew.finish(*(p.w));
+					txedge_col_encoder::write_index(*(p.w),p.ew.col_idx,p.ew.pos);
+					p.ew.col_idx.clear();
+				}
+				close_part(p);
+				if(ew0.fmt == out_bin && !error) {
+					// note: the file is opened again without O_APPEND for pwrite()
+					int fd = open(p.fn.c_str(),O_WRONLY);
+					if(fd < 0 || !txedge_bin_finish(fd,0,p.ew.edges,p.ew.min_txid,p.ew.max_txid,ew0.times ? TXEDGE_BIN_FLAG_TS : 0)) {
+						fprintf(stderr,"part_output: error updating the header of %s!\n",p.fn.c_str());
+						error = true;
+					}
+					if(fd >= 0) ::close(fd);
+				}
+				if(totals) {
+					totals->txs += p.ew.txs;
+					totals->edges += p.ew.edges;
+				}
+			}
+			parts.clear();
+			return !error;
+		}
+		
+		size_t nfiles() const { return parts.size(); }
+};
+
+
+/* periodic progress report written to stderr by a separate thread: the
+ * last txid processed, the rate of reading records and generating edges
+ * (since the last report), the position in the input files and the
+ * estimated time remaining (based on the range of txids if one is given,
+ * otherwise on the amount of input files processed) */
+class txedge_progress {
+	protected:
+		const txr_it& in;
+		const txr_it& out;
+		uint64_t size[2]; // size of the input files (0 if not known)
+		uint64_t pos0[2]; // position in the input files at the start
+		uint64_t txid_start;
+		uint64_t txid_end;
+		double interval;
+		std::atomic<uint32_t> txid;
+		std::atomic<uint64_t> edges;
+		std::chrono::steady_clock::time_point start;
+		std::thread th;
+		std::mutex m;
+		std::condition_variable cv;
+		bool stopped;
+		
+		static uint64_t file_size(const char* fn) {
+			struct stat st;
+			if(stat(fn,&st) || !S_ISREG(st.st_mode)) return 0;
+			return st.st_size;
+		}
+		
+		static void write_time(char* buf, size_t len, double t) {
+			uint64_t s = (uint64_t)t;
+			snprintf(buf,len,"%lu:%02u:%02u",(unsigned long)(s / 3600),(unsigned int)((s / 60) % 60),(unsigned int)(s % 60));
+		}
+		
+		static void write_size(char* buf, size_t len, uint64_t pos, uint64_t total) {
+			if(total) snprintf(buf,len,"%.2f / %.2f GiB",pos / 1073741824.0,total / 1073741824.0);
+			else snprintf(buf,len,"%.2f GiB",pos / 1073741824.0);
+		}
+		
+		void run() {
+			uint64_t last_recs = 0;
+			uint64_t last_edges = 0;
+			double last_t = 0.0;
+			std::unique_lock<std::mutex> lock(m);
+			while(!stopped) {
+				cv.wait_for(lock,std::chrono::duration<double>(interval));
+				if(stopped) break;
+				double t = elapsed();
+				uint64_t pos[2] = {in.bytes_read(),out.bytes_read()};
+				uint64_t recs = in.records_read() + out.records_read();
+				uint64_t e = edges.load(std::memory_order_relaxed);
+				uint32_t id = txid.load(std::memory_order_relaxed);
+				double dt = t - last_t;
+				
+				// estimate the part done
+				double done = -1.0;
+				if(txid_end <= UINT32_MAX) {
+					if(txid_end > txid_start && id >= txid_start)
+						done = (id - txid_start) / (double)(txid_end - txid_start);
+				}
+				else if(size[0] + size[1] > pos0[0] + pos0[1])
+					done = ((pos[0] - pos0[0]) + (pos[1] - pos0[1])) / (double)((size[0] - pos0[0]) + (size[1] - pos0[1]));
+				
+				char tbuf[32], s1[64], s2[64], eta[64];
+				write_time(tbuf,sizeof(tbuf),t);
+				write_size(s1,sizeof(s1),pos[0],size[0]);
+				write_size(s2,sizeof(s2),pos[1],size[1]);
+				eta[0] = 0;
+				if(done > 0.0 && done <= 1.0) {
+					char buf[32];
+					write_time(buf,sizeof(buf),t * (1.0 - done) / done);
+					snprintf(eta,sizeof(eta),", %.1f%% done, ETA %s",100.0 * done,buf);
+				}
+				fprintf(stderr,"progress: %s, txid %u, %.3gM records/s, %.3gM edges/s, txin: %s, txout: %s%s\n",
+					tbuf,id,(recs - last_recs) / dt / 1e6,(e - last_edges) / dt / 1e6,s1,s2,eta);
+				last_recs = recs;
+				last_edges = e;
+				last_t = t;
+			}
+		}
+		
+	public:
+		/* in_, out_: inputs being read (from the files in_fn and out_fn);
+		 * txid_start_, txid_end_: range of txids processed (see -r and -R);
+		 * interval_: time between reports in seconds */
+		txedge_progress(const txr_it& in_, const txr_it& out_, const char* in_fn, const char* out_fn,
+				uint64_t txid_start_, uint64_t txid_end_, double interval_) :
+				in(in_), out(out_), txid_start(txid_start_), txid_end(txid_end_), interval(interval_),
+				txid(0), edges(0), stopped(false) {
+			size[0] = file_size(in_fn);
+			size[1] = file_size(out_fn);
+			pos0[0] = std::min(in.bytes_read(),size[0]);
+			pos0[1] = std::min(out.bytes_read(),size[1]);
+			start = std::chrono::steady_clock::now();
+			th = std::thread(&txedge_progress::run,this);
+		}
+		~txedge_progress() { stop(); }
+		txedge_progress(const txedge_progress&) = delete;
+		txedge_progress& operator = (const txedge_progress&) = delete;
+		
+		/* update the last transaction processed and the number of edges
+		 * generated so far (called by the thread processing transactions) */
+		void update(uint32_t txid_, uint64_t edges_) {
+			txid.store(txid_,std::memory_order_relaxed);
+			edges.store(edges_,std::memory_order_relaxed);
+		}
 		
-		while(tx_it.read_next()) {
-			txs++;
-			for(tx::iterator it = tx_it.get_iterator();!it.is_end();++it) {
-				edges++;
-				fprintf(stdout,"%u\t%d\t%d\t%.17g\n",it->txid,it->addr_in,it->addr_out,it->w);
+		/* stop reporting */
+		void stop() {
+			{
+				std::unique_lock<std::mutex> lock(m);
+				stopped = true;
+				cv.notify_all();
 			}
+			if(th.joinable()) th.join();
 		}
-		fprintf(stderr,"%lu transactions matched, %lu edges generated\n",txs,edges);
+		
+		/* time since the start in seconds */
+		double elapsed() const {
+			std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+			return d.count();
+		}
+};
+
+
+/* process transactions in parallel: the input is split into chunks of
+ * consecutive transactions (so that no transaction is split between
+ * chunks); these are processed by a pool of worker threads, and the
+ * output is written in the original order */
+class tx_parallel {
+	protected:
+		struct chunk {
+			std::vector<txrecord> ins;
+			std::vector<txrecord> outs;
+			mem_buf res; // formatted output
+			edge_writer ew;
+			std::map<uint32_t,std::pair<mem_buf,edge_writer> > parts; // output by period if using part_output
+			mem_buf mining_res; // outputs of mining transactions if collected
+			// addresses of transactions for clustering and statistics
+			// (inputs, then outputs of each transaction, see run())
+			struct tx_info { uint32_t txid, n_in, n_out; };
+			std::vector<std::pair<int,int64_t> > tx_addrs;
+			std::vector<tx_info> txs;
+			tx_shapes shapes; // shapes of transactions if collected (see run())
+			bool done;
+			chunk(const edge_writer& ew_, size_t shapes_k):ew(ew_),shapes(shapes_k),done(false) { }
+		};
+		
+		txr_it& in;
+		txr_it& out;
+		size_t chunk_size; // minimum number of input records in one chunk
+		edge_writer ew0; // output format and settings (copied for each chunk)
+		part_output* po; // if not null, output is partitioned with this
+		bool mining; // collect outputs of mining transactions
+		addr_map* remap; // if not null, addresses are renumbered by the splitter
+		const addr_clusters* clusters; // if not null, addresses are replaced by cluster IDs by the splitter
+		const tx_times* window; // if not null, transactions outside the time window are skipped
+		addr_clusters* uf; // if not null, clusters are computed with this (see run())
+		txaddr_stats* stats; // if not null, statistics of addresses are computed with this (see run())
+		tx_shapes* shapes; // if not null, shapes of transactions are collected in this (see run())
+		size_t max_chunks; // maximum number of chunks in memory
+		
+		spsc_queue<chunk*> tasks; // chunks to be processed by the workers
+		std::deque<chunk*> chunks; // all chunks not written yet in order
+		bool split_done;
+		bool stop; // set if processing should stop early (after an error)
+		std::mutex m;
+		std::condition_variable cv;
+		
+		// create chunks from the input
+		/* replace addresses by cluster IDs and renumber them in a chunk in
+		 * the same order as tx_t would do: for each transaction with inputs
+		 * and outputs, inputs first, then outputs, in the order of the records */
+		int32_t map_addr(int32_t addr) {
+			if(clusters) addr = clusters->lookup(addr);
+			if(remap) addr = remap->map(addr);
+			return addr;
+		}
+		void remap_chunk(chunk* c) {
+			size_t j = 0;
+			for(size_t i = 0; i < c->ins.size();) {
+				unsigned int txid = c->ins[i].txid;
+				size_t i2 = i;
+				for(;i2 < c->ins.size() && c->ins[i2].txid == txid;i2++);
+				for(;j < c->outs.size() && c->outs[j].txid < txid;j++);
+				size_t j2 = j;
+				for(;j2 < c->outs.size() && c->outs[j2].txid == txid;j2++);
+				if(j2 > j && !(window && window->get(txid) == 0)) {
+					for(size_t k=i;k<i2;k++) c->ins[k].addr = map_addr(c->ins[k].addr);
+					for(size_t k=j;k<j2;k++) c->outs[k].addr = map_addr(c->outs[k].addr);
+				}
+				i = i2;
+				j = j2;
+			}
+		}
+		
+		void splitter() {
+			// if collecting outputs of mining transactions, outputs left after
+			// all inputs were read are processed as well (in the last chunk)
+			while(!out.is_end() && (!in.is_end() || mining)) {
+				{
+					std::unique_lock<std::mutex> lock(m);
+					cv.wait(lock,[this]() { return chunks.size() < max_chunks || stop; });
+					if(stop) break;
+				}
+				chunk* c = new chunk(ew0,shapes ? shapes->top_k() : 0);
+				// inputs: at least chunk_size records, ending at a transaction boundary
+				while(!in.is_end()) {
+					if(c->ins.size() >= chunk_size && in->txid != c->ins.back().txid) break;
+					c->ins.push_back(*in);
+					++in;
+				}
+				// outputs: all up to the first input not included in this chunk
+				// (outputs of transactions without inputs are ignored anyway)
+				unsigned int last = c->ins.size() ? c->ins.back().txid : 0;
+				for(;!out.is_end();++out) {
+					// (if collecting outputs of mining transactions, the last
+					// chunk includes all remaining outputs)
+					if(in.is_end() ? (out->txid > last && !mining) : (out->txid >= in->txid)) break;
+					c->outs.push_back(*out);
+				}
+				if(remap || clusters) remap_chunk(c);
+				{
+					std::unique_lock<std::mutex> lock(m);
+					chunks.push_back(c);
+				}
+				tasks.push(std::move(c));
+			}
+			tasks.close();
+			std::unique_lock<std::mutex> lock(m);
+			split_done = true;
+			cv.notify_all();
+		}
+		
+		void worker() {
+			chunk* c;
+			while(tasks.pop(c)) {
+				txr_vec_it in_it(c->ins);
+				txr_vec_it out_it(c->outs);
+				tx_t<txr_vec_it> t(in_it,out_it);
+				std::vector<txrecord> skipped;
+				if(mining) t.set_skipped(&skipped);
+				if(window) t.set_window(window);
+				auto t0 = std::chrono::steady_clock::now();
+				while(t.read_next()) {
+					if(uf || stats) {
+						const auto& ins = t.get_inputs();
+						const auto& outs = t.get_outputs();
+						c->tx_addrs.insert(c->tx_addrs.end(),ins.begin(),ins.end());
+						c->tx_addrs.insert(c->tx_addrs.end(),outs.begin(),outs.end());
+						c->txs.push_back({t.get_txid(),(uint32_t)ins.size(),(uint32_t)outs.size()});
+					}
+					uint32_t period;
+					if(!po) c->ew.add(t,c->res);
+					else if(!po->get_period(t.get_txid(),period)) {
+						if(!ew0.ts_window) c->ew.no_ts++;
+					}
+					else {
+						auto it = c->parts.find(period);
+						if(it == c->parts.end()) it = c->parts.emplace(period,std::make_pair(mem_buf(),ew0)).first;
+						it->second.second.add(t,it->second.first);
+					}
+					if(shapes) {
+						// time since the previous transaction was finished
+						auto t1 = std::chrono::steady_clock::now();
+						c->shapes.add(t.get_txid(),t.get_inputs().size(),t.get_outputs().size(),
+							std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+						t0 = t1;
+					}
+				}
+				c->ew.finish(c->res);
+				for(auto& x : c->parts) x.second.second.finish(x.second.first);
+				if(mining) {
+					// all outputs left in the chunk are not matched to inputs
+					t.drain_outputs();
+					c->ew.add_mining(skipped,c->mining_res);
+				}
+				std::unique_lock<std::mutex> lock(m);
+				c->done = true;
+				cv.notify_all();
+			}
+		}
+		
+	public:
+		/* ew: output format and settings; chunks are written with copies of it
+		 * po_: if not null, output is partitioned with it (see part_output)
+		 * mining_: collect outputs of mining transactions (see run())
+		 * remap_: if not null, addresses are renumbered using it
+		 * clusters_: if not null, addresses are replaced by their cluster IDs
+		 * uf_: if not null, clusters of input addresses are computed with it
+		 * stats_: if not null, statistics of addresses are computed with it
+		 * shapes_: if not null, shapes of transactions are collected in it */
+		tx_parallel(txr_it& in_, txr_it& out_, unsigned int nworkers, const edge_writer& ew, part_output* po_ = 0,
+				bool mining_ = false, addr_map* remap_ = 0, const addr_clusters* clusters_ = 0, addr_clusters* uf_ = 0,
+				txaddr_stats* stats_ = 0, tx_shapes* shapes_ = 0, size_t chunk_size_ = 65536):
+			in(in_),out(out_),chunk_size(chunk_size_),ew0(ew.copy_settings()),po(po_),mining(mining_),remap(remap_),
+			clusters(clusters_),window(ew.ts_window ? ew.times : 0),uf(uf_),stats(stats_),shapes(shapes_),max_chunks(4*nworkers),tasks(4*nworkers),split_done(false),stop(false) { }
+		
+		/* process all transactions using nworkers threads, write the output
+		 * to w (or to po); the number of transactions and edges (and the
+		 * columnar chunks written) are added to ew (when using po, the
+		 * numbers are added to the files in po instead); outputs of mining
+		 * transactions are written to mw if they are collected; if edges are
+		 * aggregated (see edge_writer::aggregate), they are added to agg;
+		 * progress is updated in prog after each chunk if it is given;
+		 * returns false if processing was stopped because of an error
+		 * adding the edges to agg */
+		bool run(buf_writer& w, unsigned int nworkers, edge_writer& ew, buf_writer* mw = 0, pair_agg* agg = 0,
+				txedge_progress* prog = 0) {
+			bool ret = true;
+			std::thread split_th(&tx_parallel::splitter,this);
+			std::vector<std::thread> workers;
+			for(unsigned int i=0;i<nworkers;i++) workers.emplace_back(&tx_parallel::worker,this);
+			
+			while(true) {
+				chunk* c;
+				{
+					std::unique_lock<std::mutex> lock(m);
+					cv.wait(lock,[this]() { return (chunks.size() && chunks.front()->done) ||
+						(split_done && chunks.empty()); });
+					if(chunks.empty()) break;
+					c = chunks.front();
+					chunks.pop_front();
+					cv.notify_all(); // the splitter might be waiting for space
+				}
+				if(!ret) {
+					// chunks still in progress after an error are discarded
+					delete c;
+					continue;
+				}
+				if(agg && !c->ew.flush_agg(*agg)) {
+					// stop at the first error (e.g. writing temporary files)
+					ret = false;
+					std::unique_lock<std::mutex> lock(m);
+					stop = true;
+					cv.notify_all();
+				}
+				w.write(c->res.data.data(),c->res.len);
+				ew.append(c->ew);
+				if(po) for(const auto& x : c->parts) po->add_chunk(x.first,x.second.first,x.second.second);
+				if(mw) mw->write(c->mining_res.data.data(),c->mining_res.len);
+				// clustering and statistics are updated here, in order
+				auto it = c->tx_addrs.cbegin();
+				for(const auto& x : c->txs) {
+					if(uf) uf->add_tx(it,it + x.n_in,it + x.n_in,it + (x.n_in + x.n_out),remap ? remap->unknown_id() : -1);
+					if(stats) stats->add_tx(x.txid,it,it + x.n_in,it + x.n_in,it + (x.n_in + x.n_out));
+					it += x.n_in + x.n_out;
+				}
+				if(shapes) shapes->merge(c->shapes);
+				if(prog && (c->ins.size() || c->outs.size()))
+					prog->update(c->ins.size() ? c->ins.back().txid : c->outs.back().txid,ew.edges);
+				delete c;
+			}
+			
+			split_th.join();
+			for(auto& th : workers) th.join();
+			return ret;
+		}
+};
+
+
+/* parse a range given as "start,end" (end is exclusive), return true if successful */
+static bool parse_range(const char* str, uint64_t* range) {
+	unsigned long long a, b;
+	char tmp;
+	if(sscanf(str,"%llu,%llu%c",&a,&b,&tmp) != 2 || a > b) return false;
+	range[0] = a;
+	range[1] = b;
+	return true;
+}
+
+
+/* parse a non-negative integer (only digits), return true if successful */
+static bool parse_uint64(const char* str, uint64_t& x) {
+	if(*str < '0' || *str > '9') return false;
+	char* end;
+	errno = 0;
+	unsigned long long y = strtoull(str,&end,10);
+	if(*end || errno) return false;
+	x = y;
+	return true;
+}
+
+
+/* write a string to f as a JSON string (with quotes) */
+static void json_write_str(FILE* f, const char* str) {
+	fputc('"',f);
+	for(;*str;str++) {
+		unsigned char c = *str;
+		if(c == '"' || c == '\\') fprintf(f,"\\%c",c);
+		else if(c < 0x20) fprintf(f,"\\u%04x",(unsigned int)c);
+		else fputc(c,f);
+	}
+	fputc('"',f);
+}
+
+/* write statistics of a run to the given file as JSON (see -J)
+ * returns false on error */
+static bool write_json_stats(const char* fn, int argc, char** argv, double wall_time, const edge_writer& ew,
+		const txr_it& in_it, const txr_it& out_it, const char* txin, const char* txout,
+		unsigned int nthreads, unsigned int nworkers) {
+	FILE* f = fopen(fn,"w");
+	if(!f) return false;
+	fprintf(f,"{\n\t\"version\": 1,\n\t\"command\": [");
+	for(int i=0;i<argc;i++) {
+		if(i) fprintf(f,", ");
+		json_write_str(f,argv[i]);
+	}
+	fprintf(f,"],\n\t\"threads\": %u,\n\t\"workers\": %u,\n",nthreads,nworkers);
+	fprintf(f,"\t\"wall_time\": %.6f,\n",wall_time);
+	fprintf(f,"\t\"transactions\": %lu,\n\t\"edges\": %lu,\n",(unsigned long)ew.txs,(unsigned long)ew.edges);
+	fprintf(f,"\t\"min_txid\": %u,\n\t\"max_txid\": %u,\n",ew.min_txid,ew.max_txid);
+	fprintf(f,"\t\"no_timestamp\": %lu,\n\t\"mining_outputs\": %lu,\n",(unsigned long)ew.no_ts,(unsigned long)ew.mining);
+	const char* names[2] = {"txin","txout"};
+	const char* fns[2] = {txin,txout};
+	const txr_it* its[2] = {&in_it,&out_it};
+	uint64_t recs = 0;
+	fprintf(f,"\t\"inputs\": {\n");
+	for(int j=0;j<2;j++) {
+		fprintf(f,"\t\t\"%s\": {\"file\": ",names[j]);
+		json_write_str(f,fns[j]);
+		fprintf(f,", \"records\": %lu, \"bytes_read\": %lu}%s\n",(unsigned long)its[j]->records_read(),
+			(unsigned long)its[j]->bytes_read(),j ? "" : ",");
+		recs += its[j]->records_read();
+	}
+	fprintf(f,"\t},\n\t\"output_bytes\": %lu,\n",(unsigned long)txedge_out_bytes.load());
+	fprintf(f,"\t\"records_per_s\": %.1f,\n\t\"edges_per_s\": %.1f,\n",
+		wall_time > 0.0 ? recs / wall_time : 0.0,wall_time > 0.0 ? ew.edges / wall_time : 0.0);
+	fprintf(f,"\t\"stage_time\": {");
+	for(int j=0;j<txedge_nstages;j++)
+		fprintf(f,"%s\n\t\t\"%s\": %.6f",j ? "," : "",txedge_stage_names[j],txedge_timer::total((txedge_stage)j));
+	fprintf(f,"\n\t}\n}\n");
+	bool ret = !ferror(f);
+	if(fclose(f)) ret = false;
+	return ret;
+}
+
+
+/* main() can be left out (by defining TXEDGE_NO_MAIN) to use the above in
+ * other programs, e.g. the benchmarks in bench/bench_stages.cpp */
+#ifndef TXEDGE_NO_MAIN
+int main(int argc, char **argv)
+{
+	char* txin = 0;
+	char* txout = 0;
+	char* txfile = 0; // tx.dat and bh.dat, used for adding timestamps
+	char* bhfile = 0;
+	auto start_time = std::chrono::steady_clock::now();
+	
+	bool in_gz = false;
+	bool in_xz = false;
+	bool out_gz = false;
+	bool out_xz = false;
+	bool tx_gz = false;
+	bool tx_xz = false;
+	bool bh_gz = false;
+	bool bh_xz = false;
+	
+	unsigned int xz_threads = 0; // 0: use all available CPUs
+	unsigned int nthreads = 1; // > 1: read inputs and write output in separate threads
+	unsigned int nworkers = 1; // > 1: process transactions in this many threads
+	bool old_format = false;
+	out_format fmt = out_tsv;
+	txedge_col_wmode col_wmode = TXEDGE_COL_W_EXACT;
+	unsigned int col_wdigits = 0;
+	uint64_t bipartite_min = UINT64_MAX; // see -B and -H
+	uint64_t txid_range[2] = {0, ((uint64_t)UINT32_MAX) + 1}; // see -r
+	uint64_t ts_range[2] = {0, UINT64_MAX}; // see -R
+	bool ts_range_set = false;
+	bool build_index = false; // see -X
+	const char* part_prefix = 0; // see -P
+	part_output::period_type part_type = part_output::day;
+	unsigned int part_max_open = 64;
+	const char* mining_file = 0; // see -M
+	bool aggregate = false; // see -A
+	bool agg_loops = true;
+	size_t agg_mem = 1024; // memory limit for -A in MiB
+	const char* csr_file = 0; // see -G
+	const char* remap_file = 0; // see -N
+	const char* cl_out_file = 0; // see -U
+	const char* stats_file = 0; // see -S
+	bool stats_bin = false;
+	const char* cl_in_file = 0; // see -u
+	bool cl_in_gz = false;
+	bool cl_in_xz = false;
+	bool csr_csc = false;
+	double progress_interval = 0.0; // see -p
+	const char* json_file = 0; // see -J
+	const char* shapes_file = 0; // see -K
+	size_t shapes_k = 20;
+	const char* tmpdir = getenv("TMPDIR");
+	if(!tmpdir) tmpdir = "/tmp";
+	txr_cols in_cols = txin_cols;
+	txr_cols out_cols = txout_cols;
+	bool in_cols_set = false;
+	
+	for(int i=1;i<argc;i++) if(argv[i][0] == '-') switch(argv[i][1]) {
+		case 'i':
+			txin = argv[i+1];
+			if(argv[i][2] == 'x') in_xz = true;
+			if(argv[i][2] == 'z') in_gz = true;
+			i++;
+			break;
+		case 'o':
+			txout = argv[i+1];
+			if(argv[i][2] == 'x') out_xz = true;
+			if(argv[i][2] == 'z') out_gz = true;
+			i++;
+			break;
+		case 't':
+			txfile = argv[i+1];
+			if(argv[i][2] == 'x') tx_xz = true;
+			if(argv[i][2] == 'z') tx_gz = true;
+			i++;
+			break;
+		case 'h':
+			bhfile = argv[i+1];
+			if(argv[i][2] == 'x') bh_xz = true;
+			if(argv[i][2] == 'z') bh_gz = true;
+			i++;
+			break;
+		case '1':
+			old_format = true;
+			break;
+		case 's':
+			// write weights in the shortest form instead of %.17g
+			fmt = out_tsv_short;
+			break;
+		case 'b':
+			// binary output
+			fmt = out_bin;
+			break;
+		case 'c':
+			// columnar output, weights stored exactly (-c), as float (-cf)
+			// or as fixed-point numbers with the given number of digits (-cd N)
+			fmt = out_col;
+			if(argv[i][2] == 'f') col_wmode = TXEDGE_COL_W_F32;
+			if(argv[i][2] == 'd') {
+				if(i+1 >= argc) {
+					fprintf(stderr,"Missing number of digits for -cd!\n");
+					return 1;
+				}
+				col_wmode = TXEDGE_COL_W_FIXED;
+				col_wdigits = atoi(argv[i+1]);
+				if(col_wdigits > 18) {
+					fprintf(stderr,"Invalid number of digits for -cd!\n");
+					return 1;
+				}
+				i++;
+			}
+			break;
+		case 'B':
+			// bipartite representation for all transactions
+			bipartite_min = 0;
+			break;
+		case 'H':
+			// bipartite representation for transactions with more than the given number of NxM edges
+			if(i+1 >= argc || !parse_uint64(argv[i+1],bipartite_min)) {
+				fprintf(stderr,"Invalid threshold for -H!\n");
+				return 1;
+			}
+			i++;
+			break;
+		case 'r':
+			// process only transactions with start <= txid < end
+			if(i+1 >= argc || !parse_range(argv[i+1],txid_range) || txid_range[0] > UINT32_MAX ||
+					txid_range[1] > ((uint64_t)UINT32_MAX) + 1) {
+				fprintf(stderr,"Invalid txid range for -r!\n");
+				return 1;
+			}
+			i++;
+			break;
+		case 'R':
+			// process only transactions with start <= timestamp < end (requires -t and -h)
+			if(i+1 >= argc || !parse_range(argv[i+1],ts_range) || ts_range[0] > UINT32_MAX) {
+				fprintf(stderr,"Invalid time range for -R!\n");
+				return 1;
+			}
+			ts_range_set = true;
+			i++;
+			break;
+		case 'P':
+			// partitioned output by day (-Pd) or month (-Pm)
+			if(i+1 >= argc || (argv[i][2] != 'd' && argv[i][2] != 'm')) {
+				fprintf(stderr,"Invalid arguments for -P!\n");
+				return 1;
+			}
+			part_type = (argv[i][2] == 'm') ? part_output::month : part_output::day;
+			part_prefix = argv[i+1];
+			i++;
+			break;
+		case 'F':
+			// maximum number of open files for -P
+			if(i+1 >= argc || atoi(argv[i+1]) <= 0) {
+				fprintf(stderr,"Invalid number of open files for -F!\n");
+				return 1;
+			}
+			part_max_open = atoi(argv[i+1]);
+			i++;
+			break;
+		case 'M':
+			// write outputs of mining transactions to this file
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -M!\n");
+				return 1;
+			}
+			mining_file = argv[i+1];
+			i++;
+			break;
+		case 'A':
+			// aggregate edges by address pairs (-As: without self-loops)
+			aggregate = true;
+			if(argv[i][2] == 's') agg_loops = false;
+			break;
+		case 'G':
+			// write the aggregated graph in CSR format to the given file
+			// (-Gt: include the transposed graph as well); implies -A
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -G!\n");
+				return 1;
+			}
+			csr_file = argv[i+1];
+			if(argv[i][2] == 't') csr_csc = true;
+			aggregate = true;
+			i++;
+			break;
+		case 'N':
+			// renumber addresses densely, write the table of new IDs to this file
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -N!\n");
+				return 1;
+			}
+			remap_file = argv[i+1];
+			i++;
+			break;
+		case 'S':
+			// statistics of addresses, written to this file as TSV (-S) or binary (-Sb)
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -S!\n");
+				return 1;
+			}
+			stats_file = argv[i+1];
+			if(argv[i][2] == 'b') stats_bin = true;
+			i++;
+			break;
+		case 'U':
+			// compute clusters of addresses (common-input heuristic), write them to this file
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -U!\n");
+				return 1;
+			}
+			cl_out_file = argv[i+1];
+			i++;
+			break;
+		case 'u':
+			// read clusters of addresses, write edges between clusters
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -u!\n");
+				return 1;
+			}
+			cl_in_file = argv[i+1];
+			if(argv[i][2] == 'x') cl_in_xz = true;
+			if(argv[i][2] == 'z') cl_in_gz = true;
+			i++;
+			break;
+		case 'm':
+			// memory limit for -A (in MiB)
+			if(i+1 >= argc || (agg_mem = strtoull(argv[i+1],0,10)) == 0) {
+				fprintf(stderr,"Invalid memory limit for -m!\n");
+				return 1;
+			}
+			i++;
+			break;
+		case 'D':
+			// directory for temporary files (for -A)
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing directory name for -D!\n");
+				return 1;
+			}
+			tmpdir = argv[i+1];
+			i++;
+			break;
+		case 'X':
+			// build indexes for the input files
+			build_index = true;
+			break;
+		case 'T':
+			if(i+1 >= argc || atoi(argv[i+1]) <= 0) {
+				fprintf(stderr,"Invalid number of threads for -T!\n");
+				return 1;
+			}
+			xz_threads = atoi(argv[i+1]);
+			i++;
+			break;
+		case 'j':
+			if(i+1 >= argc || atoi(argv[i+1]) <= 0) {
+				fprintf(stderr,"Invalid number of threads for -j!\n");
+				return 1;
+			}
+			nthreads = atoi(argv[i+1]);
+			i++;
+			break;
+		case 'w':
+			if(i+1 >= argc || atoi(argv[i+1]) <= 0) {
+				fprintf(stderr,"Invalid number of threads for -w!\n");
+				return 1;
+			}
+			nworkers = atoi(argv[i+1]);
+			i++;
+			break;
+		case 'I':
+			if(i+1 >= argc || !in_cols.parse(argv[i+1])) {
+				fprintf(stderr,"Invalid column specification for -I!\n");
+				return 1;
+			}
+			in_cols_set = true;
+			i++;
+			break;
+		case 'O':
+			if(i+1 >= argc || !out_cols.parse(argv[i+1])) {
+				fprintf(stderr,"Invalid column specification for -O!\n");
+				return 1;
+			}
+			i++;
+			break;
+		case 'p':
+			// report progress periodically (interval in seconds)
+			if(i+1 >= argc || (progress_interval = atof(argv[i+1])) <= 0.0) {
+				fprintf(stderr,"Invalid interval for -p!\n");
+				return 1;
+			}
+			i++;
+			break;
+		case 'J':
+			// write statistics of the run (including the time spent in each stage) as JSON
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -J!\n");
+				return 1;
+			}
+			json_file = argv[i+1];
+			i++;
+			break;
+		case 'K':
+			// write histograms of the shape of transactions and the largest ones
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing file name for -K!\n");
+				return 1;
+			}
+			shapes_file = argv[i+1];
+			i++;
+			break;
+		case 'k':
+			// number of transactions to list in the output of -K
+			if(i+1 >= argc) {
+				fprintf(stderr,"Missing number for -k!\n");
+				return 1;
+			}
+			shapes_k = strtoull(argv[i+1],0,10);
+			i++;
+			break;
+		default:
+			fprintf(stderr,"Unknown command line argument: %s!\n",argv[i]);
+			break;
 	}
-	else fprintf(stderr,"Error opening input files!\n");
 	
-	if(in) {
-		if(in_gz || in_xz) pclose(in);
-		else fclose(in);
+	if(old_format && !in_cols_set) in_cols = txin_cols_old;
+	if(fmt == out_col && bipartite_min != UINT64_MAX) {
+		fprintf(stderr,"The columnar output (-c) already stores transactions instead of edges, it cannot be combined with -B or -H!\n");
+		return 1;
 	}
-	if(out) {
-		if(out_gz || out_xz) pclose(out);
-		else fclose(out);
+	if(aggregate && (fmt == out_bin || fmt == out_col || bipartite_min != UINT64_MAX || part_prefix)) {
+		fprintf(stderr,"Aggregated output (-A) can only be written as TSV, it cannot be combined with -b, -c, -B, -H or -P!\n");
+		return 1;
 	}
 	
+	if( !(txin && txout) ) {
+		fprintf(stderr,"Error: missing input file names!\n");
+		return 1;
+	}
+	if(build_index) {
+		// build the index for both files, see txindex.h
+		const char* fns[2] = {txin, txout};
+		bool xz[2] = {in_xz, out_xz};
+		bool gz[2] = {in_gz, out_gz};
+		unsigned int cols[2] = {in_cols.txid, out_cols.txid};
+		for(int j=0;j<2;j++) {
+			if(gz[j]) {
+				fprintf(stderr,"Error: indexing gzip compressed files is not supported (%s)!\n",fns[j]);
+				return 1;
+			}
+			std::string idx_fn = std::string(fns[j]) + ".idx";
+			if(!tx_index::build(fns[j],xz[j],cols[j],idx_fn.c_str(),xz_threads)) {
+				fprintf(stderr,"Error creating index for %s!\n",fns[j]);
+				return 1;
+			}
+		}
+		return 0;
+	}
+	
+	if( (txfile && !bhfile) || (bhfile && !txfile) ) {
+		fprintf(stderr,"Error: both tx.dat and bh.dat are needed for timestamps (-t and -h)!\n");
+		return 1;
+	}
+	if(part_prefix && !txfile) {
+		fprintf(stderr,"Error: partitioned output (-P) requires tx.dat and bh.dat (-t and -h)!\n");
+		return 1;
+	}
+	if(ts_range_set && !txfile) {
+		fprintf(stderr,"Error: selecting a time range (-R) requires tx.dat and bh.dat (-t and -h)!\n");
+		return 1;
+	}
+	
+	// read timestamps first if needed
+	tx_times* times = 0;
+	if(txfile) {
+		txinput tx_in;
+		txinput bh_in;
+		tx_in.open(txfile,tx_gz,tx_xz,xz_threads);
+		bh_in.open(bhfile,bh_gz,bh_xz,xz_threads);
+		if(!(tx_in.is_open() && bh_in.is_open())) {
+			fprintf(stderr,"Error opening input files!\n");
+			return 1;
+		}
+		times = new tx_times();
+		if(ts_range_set) times->set_window(ts_range[0],ts_range[1]);
+		if(!times->read(tx_in,txfile,bh_in,bhfile)) {
+			fprintf(stderr,"Error reading timestamps!\n");
+			delete times;
+			return 1;
+		}
+		if(ts_range_set) {
+			// restrict the range of txids to the ones in the time window
+			uint32_t txid_min;
+			uint64_t txid_end;
+			times->get_range(txid_min,txid_end);
+			txid_range[0] = std::max(txid_range[0],(uint64_t)txid_min);
+			txid_range[1] = std::min(txid_range[1],txid_end);
+		}
+	}
+	
+	// read clusters if needed
+	addr_clusters* clusters = 0;
+	if(cl_in_file) {
+		txinput cl_in;
+		clusters = new addr_clusters();
+		if(!cl_in.open(cl_in_file,cl_in_gz,cl_in_xz,xz_threads) || !clusters->read(cl_in,cl_in_file)) {
+			fprintf(stderr,"Error reading clusters from %s!\n",cl_in_file);
+			delete clusters;
+			if(times) delete times;
+			return 1;
+		}
+	}
+	
+	// measure the time spent in each stage if writing statistics
+	if(json_file) txedge_timer::enable();
+	
+	txinput in;
+	txinput out;
+	
+	// open transaction inputs and outputs files
+	in.open(txin,in_gz,in_xz,xz_threads);
+	out.open(txout,out_gz,out_xz,xz_threads);
+	
+	if(in.is_open() && out.is_open()) {
+		// skip to the start of the range if the files are indexed
+		if(txid_range[0] > 0 && txid_range[0] < txid_range[1]) {
+			in.seek(txin,txid_range[0]);
+			out.seek(txout,txid_range[0]);
+		}
+		txr_it in_it(in,in_cols,txin);
+		txr_it out_it(out,out_cols,txout);
+		if(txid_range[0] > 0 || txid_range[1] <= UINT32_MAX) {
+			uint64_t end = std::max(txid_range[0],txid_range[1]);
+			in_it.set_range(txid_range[0],end);
+			out_it.set_range(txid_range[0],end);
+		}
+		// pipelined mode: inputs are read and parsed in separate threads,
+		// transactions are processed in this thread (or by nworkers worker
+		// threads) and output is written in a separate thread
+		bool pipelined = (nthreads > 1 || nworkers > 1);
+		bool out_error = false; // set if writing any of the outputs failed
+		if(pipelined) {
+			in_it.start_thread();
+			out_it.start_thread();
+		}
+		else if(txedge_timer::is_enabled()) {
+			in_it.start_batches();
+			out_it.start_batches();
+		}
+		buf_writer w(STDOUT_FILENO,1U << 22,pipelined,txedge_write_stats);
+		
+		edge_writer ew(fmt,bipartite_min,txedge_col_encoder(col_wmode,col_wdigits,times != 0));
+		ew.times = times;
+		ew.ts_window = ts_range_set;
+		ew.aggregate = aggregate;
+		ew.agg_loops = agg_loops;
+		pair_agg* agg = 0;
+		if(aggregate) agg = new pair_agg(agg_mem << 20,tmpdir);
+		addr_map* remap = 0;
+		if(remap_file) remap = new addr_map();
+		addr_clusters* uf = 0;
+		if(cl_out_file) uf = new addr_clusters();
+		txaddr_stats* stats = 0;
+		if(stats_file) stats = new txaddr_stats();
+		tx_shapes* shapes = 0;
+		if(shapes_file) shapes = new tx_shapes(shapes_k);
+		// the aggregated graph is written to csr_file if needed; this is opened
+		// here, so that errors are found before processing the input
+		txedge_csr_writer csr;
+		if(csr_file && !csr.open(csr_file,tmpdir)) return 1;
+		// outputs of mining transactions are written to a separate file if needed
+		int mining_fd = -1;
+		buf_writer* mw = 0;
+		if(mining_file) {
+			mining_fd = open(mining_file,O_WRONLY | O_CREAT | O_TRUNC,0644);
+			if(mining_fd < 0) {
+				fprintf(stderr,"Error opening output file %s!\n",mining_file);
+				return 1;
+			}
+			mw = new buf_writer(mining_fd,1U << 20,pipelined,txedge_write_stats);
+		}
+		// partitioned output: files are written by po instead of stdout
+		part_output* po = 0;
+		if(part_prefix) po = new part_output(ew,part_prefix,part_type,part_max_open);
+		
+		// binary output: the header is written first without the number of
+		// records, and updated at the end if the output is seekable (and not
+		// opened for appending, e.g. with >>, as pwrite() would append then)
+		off_t bin_start = -1;
+		if(fmt == out_bin && !po) {
+			int fl = fcntl(STDOUT_FILENO,F_GETFL);
+			if(fl != -1 && !(fl & O_APPEND)) bin_start = lseek(STDOUT_FILENO,0,SEEK_CUR);
+			txedge_bin_header h = {txedge_bin_version,UINT64_MAX,0,0,times ? TXEDGE_BIN_FLAG_TS : 0};
+			txedge_bin_encode_header(w.reserve(txedge_bin_header_size),h);
+			w.commit(txedge_bin_header_size);
+		}
+		// columnar output: header first, chunk index at the end
+		if(fmt == out_col && !po) {
+			ew.col.write_header(w);
+			ew.pos = txedge_col_header_size;
+		}
+		
+		txedge_progress* prog = 0;
+		if(progress_interval > 0.0) prog = new txedge_progress(in_it,out_it,txin,txout,
+			txid_range[0],txid_range[1],progress_interval);
+		
+		if(nworkers > 1) {
+			tx_parallel p(in_it,out_it,nworkers,ew,po,mw != 0,remap,clusters,uf,stats,shapes);
+			p.run(w,nworkers,ew,mw,agg,prog); // errors in agg are reported below
+		}
+		else {
+			tx tx_it(in_it,out_it);
+			std::vector<txrecord> skipped; // outputs of mining transactions
+			if(mw) tx_it.set_skipped(&skipped);
+			if(remap) tx_it.set_remap(remap);
+			if(clusters) tx_it.set_clusters(clusters);
+			if(ew.ts_window) tx_it.set_window(times);
+			ew.agg = agg; // edges are aggregated directly
+			auto tx_t0 = std::chrono::steady_clock::now();
+			while(tx_it.read_next()) {
+				if(uf) uf->add_tx(tx_it.get_inputs().cbegin(),tx_it.get_inputs().cend(),
+					tx_it.get_outputs().cbegin(),tx_it.get_outputs().cend(),remap ? remap->unknown_id() : -1);
+				if(stats) stats->add_tx(tx_it.get_txid(),tx_it.get_inputs().cbegin(),tx_it.get_inputs().cend(),
+					tx_it.get_outputs().cbegin(),tx_it.get_outputs().cend());
+				if(po) {
+					if(!po->add(tx_it) && !ew.ts_window) ew.no_ts++;
+				}
+				else ew.add(tx_it,w);
+				// stop at the first error in agg (reported below)
+				if(agg && !ew.flush_agg(*agg)) break;
+				if(mw) {
+					ew.add_mining(skipped,*mw);
+					skipped.clear();
+				}
+				if(prog) prog->update(tx_it.get_txid(),ew.edges);
+				if(shapes) {
+					// time since the previous transaction was finished
+					// (including reading and parsing this one)
+					auto t1 = std::chrono::steady_clock::now();
+					shapes->add(tx_it.get_txid(),tx_it.get_inputs().size(),tx_it.get_outputs().size(),
+						std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - tx_t0).count());
+					tx_t0 = t1;
+				}
+			}
+			if(!po) ew.finish(w);
+			if(mw) {
+				tx_it.drain_outputs();
+				ew.add_mining(skipped,*mw);
+			}
+		}
+		if(prog) delete prog;
+		if(fmt == out_col && !po) txedge_col_encoder::write_index(w,ew.col_idx,ew.pos);
+		if(agg) {
+			// write the aggregated pairs: addr_in, addr_out, total weight,
+			// number of transactions, first and last txid
+			// (or write them to csr_file if given)
+			uint64_t npairs = 0;
+			bool shortest = (fmt == out_tsv_short);
+			bool ret = agg->merge([&w,&npairs,shortest,&csr,csr_file](const pair_agg_rec& r) {
+				npairs++;
+				if(csr_file) {
+					csr.add(r.addr_in,r.addr_out,r.w);
+					return;
+				}
+				char* p = w.reserve(128);
+				char* p0 = p;
+				p = format_int32(p,r.addr_in);
+				*p++ = '\t';
+				p = format_int32(p,r.addr_out);
+				*p++ = '\t';
+				p = shortest ? format_double_short(p,r.w) : format_double17(p,r.w);
+				*p++ = '\t';
+				p = format_uint64(p,r.txs);
+				*p++ = '\t';
+				p = format_uint32(p,r.first_txid);
+				*p++ = '\t';
+				p = format_uint32(p,r.last_txid);
+				*p++ = '\n';
+				w.commit(p - p0);
+			});
+			if(!ret) {
+				fprintf(stderr,"Error aggregating edges!\n");
+				out_error = true;
+			}
+			else if(csr_file) {
+				unsigned int nth = (nworkers > 1) ? nworkers : std::thread::hardware_concurrency();
+				if(!csr.finish(csr_csc,nth)) {
+					fprintf(stderr,"Error writing the graph to %s!\n",csr_file);
+					out_error = true;
+				}
+			}
+			fprintf(stderr,"%lu unique address pairs written (%lu sorted runs written to disk)\n",npairs,agg->nruns());
+			delete agg;
+		}
+		w.close();
+		if(fmt == out_bin && !po && bin_start >= 0 && !w.has_error())
+			if(!txedge_bin_finish(STDOUT_FILENO,bin_start,ew.edges,ew.min_txid,ew.max_txid,times ? TXEDGE_BIN_FLAG_TS : 0))
+				fprintf(stderr,"Error updating the header of the binary output!\n");
+		if(mw) {
+			mw->close();
+			if(mw->has_error()) {
+				fprintf(stderr,"Error writing the outputs of mining transactions!\n");
+				out_error = true;
+			}
+			delete mw;
+			close(mining_fd);
+		}
+		if(po) {
+			size_t nfiles = po->nfiles();
+			if(!po->finish(&ew)) {
+				fprintf(stderr,"Error writing the partitioned output!\n");
+				out_error = true;
+			}
+			fprintf(stderr,"Output written to %lu files\n",nfiles);
+			delete po;
+		}
+		fprintf(stderr,"%lu transactions matched, %lu edges generated\n",ew.txs,ew.edges);
+		if(stats) {
+			int fd = open(stats_file,O_WRONLY | O_CREAT | O_TRUNC,0644);
+			bool ret = (fd >= 0);
+			if(ret) {
+				buf_writer sw(fd,1U << 20);
+				if(fmt == out_tsv_short) stats->write(sw,stats_bin,format_double_short);
+				else stats->write(sw,stats_bin,format_double17);
+				sw.close();
+				ret = !sw.has_error();
+			}
+			if(fd >= 0 && close(fd)) ret = false;
+			if(!ret) {
+				fprintf(stderr,"Error writing the statistics of addresses to %s!\n",stats_file);
+				out_error = true;
+			}
+			fprintf(stderr,"Statistics written for %lu addresses\n",stats->size());
+			delete stats;
+		}
+		if(uf) {
+			// with -N, clusters were computed with the new IDs
+			if(remap) uf->unmap(*remap);
+			int64_t n = uf->write(cl_out_file);
+			if(n < 0) {
+				fprintf(stderr,"Error writing the clusters to %s!\n",cl_out_file);
+				out_error = true;
+			}
+			else fprintf(stderr,"%ld clusters of addresses found\n",n);
+			delete uf;
+		}
+		if(remap) {
+			if(!remap->write(remap_file)) {
+				fprintf(stderr,"Error writing the address table to %s!\n",remap_file);
+				out_error = true;
+			}
+			fprintf(stderr,"%lu distinct addresses renumbered\n",remap->size());
+			delete remap;
+		}
+		if(mining_file) fprintf(stderr,"%lu outputs of mining transactions written\n",ew.mining);
+		if(ew.no_ts) fprintf(stderr,"Warning: %lu transactions without a timestamp!\n",ew.no_ts);
+		if(shapes) {
+			FILE* f = fopen(shapes_file,"w");
+			bool ret = (f != 0);
+			if(f) {
+				ret = shapes->write_json(f);
+				if(fclose(f)) ret = false;
+			}
+			if(!ret) {
+				fprintf(stderr,"Error writing the shapes of transactions to %s!\n",shapes_file);
+				out_error = true;
+			}
+			delete shapes;
+		}
+		if(json_file) {
+			std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start_time;
+			if(!write_json_stats(json_file,argc,argv,wall.count(),ew,in_it,out_it,txin,txout,nthreads,nworkers)) {
+				fprintf(stderr,"Error writing statistics to %s!\n",json_file);
+				out_error = true;
+			}
+		}
+		if(out_error) {
+			if(times) delete times;
+			if(clusters) delete clusters;
+			return 1;
+		}
+	}
+	else fprintf(stderr,"Error opening input files!\n");
+	if(times) delete times;
+	if(clusters) delete clusters;
+	
 	return 0;
 }
+#endif /* TXEDGE_NO_MAIN */
 
@@ -0,0 +1,249 @@
+/*  -*- C++ -*-
+ * txedge_bin.h -- binary file format for transaction edges, written by
+ * 	txedge -b; also includes a reader that memory maps the file
+ *
+ * format (all values are little-endian):
+ * 	header (64 bytes):
+ * 		0: magic "TXEDGEB" + '\0'
+ * 		8: uint32 version (currently 1)
+ * 		12: uint32 size of the header (64)
+ * 		16: uint32 size of one record (24)
+ * 		20: uint8[4] column types (see txedge_bin_col_type)
+ * 		24: uint64 number of records (UINT64_MAX if unknown, i.e. the output
+ * 			was not seekable; in this case, it can be computed from the
+ * 			file size)
+ * 		32: uint32 smallest txid (first record)
+ * 		36: uint32 largest txid (last record)
+ * 		40: uint32 flags (TXEDGE_BIN_FLAG_TS: records include timestamps)
+ * 		44-63: reserved (zero)
+ * 	records (24 bytes each, ordered by txid):
+ * 		0: uint32 txid
+ * 		4: int32 input address
+ * 		8: int32 output address
+ * 		12: uint32 timestamp of the transaction if TXEDGE_BIN_FLAG_TS is
+ * 			set, zero (padding) otherwise
+ * 		16: double (IEEE 754) weight
+ *
+ * example usage:
+
+txedge_bin_reader r;
+if(!r.open("edges.bin")) ... // handle error
+for(uint64_t i=0;i<r.size();i++) {
+	const txedge_bin_record& e = r[i];
+	... // use e.txid, e.addr_in, e.addr_out, e.w
+}
+
+ * note: the reader only supports little-endian systems, since records are
+ * accessed directly in the memory mapped file
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TXEDGE_BIN_H
+#define _TXEDGE_BIN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+static const char txedge_bin_magic[8] = {'T','X','E','D','G','E','B',0};
+static const uint32_t txedge_bin_version = 1;
+static const size_t txedge_bin_header_size = 64;
+static const size_t txedge_bin_record_size = 24;
+
+enum txedge_bin_col_type : uint8_t { TXEDGE_BIN_U32 = 1, TXEDGE_BIN_I32 = 2, TXEDGE_BIN_F64 = 3 };
+static const uint8_t txedge_bin_cols[4] = {TXEDGE_BIN_U32, TXEDGE_BIN_I32, TXEDGE_BIN_I32, TXEDGE_BIN_F64};
+static const uint32_t TXEDGE_BIN_FLAG_TS = 1;
+
+/* one record as stored in the file (on little-endian systems) */
+struct txedge_bin_record {
+	uint32_t txid;
+	int32_t addr_in;
+	int32_t addr_out;
+	uint32_t ts; // only if TXEDGE_BIN_FLAG_TS is set
+	double w;
+};
+static_assert(sizeof(txedge_bin_record) == 24, "txedge_bin_record: unexpected size!");
+
+/* header in memory */
+struct txedge_bin_header {
+	uint32_t version;
+	uint64_t count;
+	uint32_t min_txid;
+	uint32_t max_txid;
+	uint32_t flags;
+};
+
+
+/* helpers to store / load little-endian values independently of the host */
+static inline void txedge_bin_put32(char* p, uint32_t x) {
+	for(int i=0;i<4;i++) p[i] = (char)((x >> (8*i)) & 0xFFU);
+}
+static inline void txedge_bin_put64(char* p, uint64_t x) {
+	for(int i=0;i<8;i++) p[i] = (char)((x >> (8*i)) & 0xFFU);
+}
+static inline uint32_t txedge_bin_get32(const char* p) {
+	uint32_t x = 0;
+	for(int i=0;i<4;i++) x |= ((uint32_t)(uint8_t)p[i]) << (8*i);
+	return x;
+}
+static inline uint64_t txedge_bin_get64(const char* p) {
+	uint64_t x = 0;
+	for(int i=0;i<8;i++) x |= ((uint64_t)(uint8_t)p[i]) << (8*i);
+	return x;
+}
+
+/* encode one record into p (which should have space for 24 bytes) */
+static inline void txedge_bin_encode(char* p, uint32_t txid, int32_t addr_in, int32_t addr_out, double w, uint32_t ts = 0) {
+	uint64_t w2;
+	memcpy(&w2,&w,8);
+	txedge_bin_put32(p,txid);
+	txedge_bin_put32(p+4,(uint32_t)addr_in);
+	txedge_bin_put32(p+8,(uint32_t)addr_out);
+	txedge_bin_put32(p+12,ts);
+	txedge_bin_put64(p+16,w2);
+}
+
+/* encode the header into p (which should have space for 64 bytes) */
+static inline void txedge_bin_encode_header(char* p, const txedge_bin_header& h) {
+	memset(p,0,txedge_bin_header_size);
+	memcpy(p,txedge_bin_magic,8);
+	txedge_bin_put32(p+8,h.version);
+	txedge_bin_put32(p+12,txedge_bin_header_size);
+	txedge_bin_put32(p+16,txedge_bin_record_size);
+	memcpy(p+20,txedge_bin_cols,4);
+	txedge_bin_put64(p+24,h.count);
+	txedge_bin_put32(p+32,h.min_txid);
+	txedge_bin_put32(p+36,h.max_txid);
+	txedge_bin_put32(p+40,h.flags);
+}
+
+/* decode and check a header; returns true if it is valid */
+static inline bool txedge_bin_decode_header(const char* p, txedge_bin_header& h) {
+	if(memcmp(p,txedge_bin_magic,8)) return false;
+	h.version = txedge_bin_get32(p+8);
+	if(h.version != txedge_bin_version) return false;
+	if(txedge_bin_get32(p+12) != txedge_bin_header_size ||
+		txedge_bin_get32(p+16) != txedge_bin_record_size ||
+		memcmp(p+20,txedge_bin_cols,4)) return false;
+	h.count = txedge_bin_get64(p+24);
+	h.min_txid = txedge_bin_get32(p+32);
+	h.max_txid = txedge_bin_get32(p+36);
+	h.flags = txedge_bin_get32(p+40);
+	return true;
+}
+
+/* update the header of a file written to fd starting at offset start
+ * after all records were written
+ * returns true on success (false e.g. if fd is not seekable); fd should not
+ * be opened with O_APPEND, since pwrite() then appends to the end */
+static bool txedge_bin_finish(int fd, off_t start, uint64_t count, uint32_t min_txid, uint32_t max_txid, uint32_t flags) {
+	txedge_bin_header h;
+	h.version = txedge_bin_version;
+	h.count = count;
+	h.min_txid = min_txid;
+	h.max_txid = max_txid;
+	h.flags = flags;
+	char buf[txedge_bin_header_size];
+	txedge_bin_encode_header(buf,h);
+	return (pwrite(fd,buf,txedge_bin_header_size,start) == (ssize_t)txedge_bin_header_size);
+}
+
+
+/* read a file by memory mapping it */
+class txedge_bin_reader {
+	protected:
+		char* map;
+		size_t map_size;
+		txedge_bin_header h;
+		uint64_t n;
+
+	public:
+		txedge_bin_reader() : map(0), map_size(0), n(0) { }
+		~txedge_bin_reader() { close(); }
+		txedge_bin_reader(const txedge_bin_reader&) = delete;
+		txedge_bin_reader& operator = (const txedge_bin_reader&) = delete;
+
+		/* open and map the given file, check the header
+		 * returns false on error (an error message is written to stderr) */
+		bool open(const char* fn) {
+			close();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+			fprintf(stderr,"txedge_bin_reader: only little-endian systems are supported!\n");
+			return false;
+#endif
+			int fd = ::open(fn,O_RDONLY);
+			if(fd < 0) {
+				fprintf(stderr,"txedge_bin_reader: cannot open file %s!\n",fn);
+				return false;
+			}
+			struct stat st;
+			if(fstat(fd,&st) || (size_t)st.st_size < txedge_bin_header_size) {
+				fprintf(stderr,"txedge_bin_reader: invalid file %s!\n",fn);
+				::close(fd);
+				return false;
+			}
+			void* m = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+			::close(fd);
+			if(m == MAP_FAILED) {
+				fprintf(stderr,"txedge_bin_reader: cannot map file %s!\n",fn);
+				return false;
+			}
+			map = (char*)m;
+			map_size = st.st_size;
+			uint64_t n2 = (map_size - txedge_bin_header_size) / txedge_bin_record_size;
+			if(!txedge_bin_decode_header(map,h) || (h.count != UINT64_MAX && h.count > n2)) {
+				fprintf(stderr,"txedge_bin_reader: invalid header in file %s!\n",fn);
+				close();
+				return false;
+			}
+			n = (h.count == UINT64_MAX) ? n2 : h.count;
+			return true;
+		}
+
+		void close() {
+			if(map) munmap(map,map_size);
+			map = 0;
+			map_size = 0;
+			n = 0;
+		}
+
+		/* number of records */
+		uint64_t size() const { return n; }
+		/* access records directly */
+		const txedge_bin_record* data() const {
+			return (const txedge_bin_record*)(map + txedge_bin_header_size);
+		}
+		const txedge_bin_record& operator [] (uint64_t i) const { return data()[i]; }
+		const txedge_bin_record* begin() const { return data(); }
+		const txedge_bin_record* end() const { return data() + n; }
+		/* header information; note that min_txid and max_txid are only
+		 * valid if the number of records was known when writing */
+		const txedge_bin_header& header() const { return h; }
+};
+
+#endif /* _TXEDGE_BIN_H */
+
@@ -0,0 +1,567 @@
+/*  -*- C++ -*-
+ * txedge_col.h -- compact columnar file format for transaction edges,
+ * 	written by txedge -c; also includes a reader that memory maps the file
+ *
+ * since each transaction results in edges between all of its N input and
+ * M output addresses, these are not stored as individual edges; instead,
+ * each transaction is stored once with its txid, and the lists of input
+ * and output addresses (i.e. per-transaction address dictionaries); edges
+ * are the full N x M product of these in the same order as txedge writes
+ * them (inputs in the outer loop, addresses in increasing order)
+ *
+ * weights can be stored in three ways:
+ * 	TXEDGE_COL_W_EXACT: the N input and M output sums are stored, and
+ * 		weights are recomputed with the same formula as in txedge, giving
+ * 		exactly the same values
+ * 	TXEDGE_COL_W_F32: each edge weight is stored as a 32-bit float
+ * 	TXEDGE_COL_W_FIXED: each edge weight is stored as an integer after
+ * 		multiplying by 10^d and rounding (d is given when writing)
+ *
+ * format (all fixed-size values are little-endian, varints are LEB128, i.e.
+ * 7 bits in each byte, starting with the lowest bits):
+ * 	file header (32 bytes):
+ * 		0: magic "TXEDGEC" + '\0'
+ * 		8: uint32 version (currently 1)
+ * 		12: uint32 weight mode (see above)
+ * 		16: uint32 parameter of the weight mode (d for TXEDGE_COL_W_FIXED)
+ * 		20: uint32 flags (TXEDGE_COL_FLAG_TS: transactions have timestamps)
+ * 		24-31: reserved (zero)
+ * 	chunks, each containing consecutive transactions:
+ * 		chunk header (40 bytes):
+ * 			0: uint32 number of transactions
+ * 			4: uint32 reserved (zero)
+ * 			8: uint64 number of edges
+ * 			16: uint32 first txid
+ * 			20: uint32 last txid
+ * 			24: uint32 size of the transaction stream
+ * 			28: uint32 size of the address stream
+ * 			32: uint32 size of the weight stream
+ * 			36: uint32 reserved (zero)
+ * 		transaction stream, for each transaction:
+ * 			varint difference of txid to the previous one (or to the first txid)
+ * 			varint number of input addresses (N)
+ * 			varint number of output addresses (M)
+ * 			if TXEDGE_COL_FLAG_TS is set: zigzag varint difference of the
+ * 				timestamp to the previous one (or to zero)
+ * 		address stream, for each transaction:
+ * 			N input addresses, then M output addresses; in both lists, the
+ * 			first is stored as varint (addr + 1), the rest as varint
+ * 			(difference to the previous one - 1)
+ * 		weight stream, for each transaction:
+ * 			TXEDGE_COL_W_EXACT: N + M zigzag varint (input sums, output sums)
+ * 			TXEDGE_COL_W_F32: N x M float values
+ * 			TXEDGE_COL_W_FIXED: N x M zigzag varint values
+ * 	chunk index, for each chunk (32 bytes):
+ * 		0: uint64 offset of the chunk in the file
+ * 		8: uint32 first txid
+ * 		12: uint32 last txid
+ * 		16: uint64 number of edges
+ * 		24: uint32 number of transactions
+ * 		28: uint32 reserved (zero)
+ * 	footer (32 bytes):
+ * 		0: uint64 offset of the chunk index
+ * 		8: uint64 number of chunks
+ * 		16: uint64 total number of edges
+ * 		24: magic "TXEDGEC" + '\0'
+ *
+ * example usage:
+
+txedge_col_reader r;
+if(!r.open("edges.col")) ... // handle error
+txedge_col_edges e;
+for(size_t i = r.find_chunk(txid_start); i < r.nchunks(); i++) {
+	if(r.chunk_min_txid(i) >= txid_end) break;
+	r.decode_chunk(i,e);
+	for(size_t j=0;j<e.size();j++) ... // use e.txid[j], e.addr_in[j], e.addr_out[j], e.w[j]
+		// and e.ts[j] if r.has_ts()
+}
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TXEDGE_COL_H
+#define _TXEDGE_COL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "txedge_bin.h" // txedge_bin_put32() and similar
+
+
+static const char txedge_col_magic[8] = {'T','X','E','D','G','E','C',0};
+static const uint32_t txedge_col_version = 1;
+static const size_t txedge_col_header_size = 32;
+static const size_t txedge_col_chunk_header_size = 40;
+static const size_t txedge_col_index_entry_size = 32;
+static const size_t txedge_col_footer_size = 32;
+
+enum txedge_col_wmode : uint32_t { TXEDGE_COL_W_EXACT = 0, TXEDGE_COL_W_F32 = 1, TXEDGE_COL_W_FIXED = 2 };
+static const uint32_t TXEDGE_COL_FLAG_TS = 1;
+
+
+/* varint helpers */
+static inline void txedge_col_put_varint(std::vector<char>& v, uint64_t x) {
+	while(x >= 0x80) {
+		v.push_back((char)((x & 0x7F) | 0x80));
+		x >>= 7;
+	}
+	v.push_back((char)x);
+}
+static inline uint64_t txedge_col_zigzag(int64_t x) {
+	return (((uint64_t)x) << 1) ^ (uint64_t)(x >> 63);
+}
+static inline int64_t txedge_col_unzigzag(uint64_t x) {
+	return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+/* read a varint from p (not reading past end); returns false on error */
+static inline bool txedge_col_get_varint(const char*& p, const char* end, uint64_t& x) {
+	x = 0;
+	for(unsigned int shift = 0; shift < 64; shift += 7) {
+		if(p == end) return false;
+		uint8_t b = (uint8_t)*p++;
+		x |= ((uint64_t)(b & 0x7F)) << shift;
+		if(!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+
+/* index entry of one chunk */
+struct txedge_col_chunk_info {
+	uint64_t offset;
+	uint32_t min_txid;
+	uint32_t max_txid;
+	uint64_t edges;
+	uint32_t txs;
+};
+
+
+/* encode transactions into chunks */
+class txedge_col_encoder {
+	protected:
+		txedge_col_wmode wmode;
+		double wscale; // for TXEDGE_COL_W_FIXED
+		size_t chunk_size; // target size of chunks in bytes
+		std::vector<char> s_tx; // streams of the current chunk
+		std::vector<char> s_addr;
+		std::vector<char> s_w;
+		txedge_col_chunk_info cur;
+		uint32_t last_txid;
+		bool with_ts; // store timestamps
+		uint32_t last_ts;
+
+		template<class vec_t>
+		void put_addrs(const vec_t& v) {
+			for(size_t i=0;i<v.size();i++) {
+				int64_t a = v[i].first;
+				if(i == 0) txedge_col_put_varint(s_addr,(uint64_t)(a + 1));
+				else txedge_col_put_varint(s_addr,(uint64_t)(a - v[i-1].first - 1));
+			}
+		}
+
+	public:
+		/* wdigits: number of decimal digits for TXEDGE_COL_W_FIXED
+		 * with_ts_: store a timestamp for each transaction */
+		explicit txedge_col_encoder(txedge_col_wmode wmode_ = TXEDGE_COL_W_EXACT, unsigned int wdigits = 0,
+				bool with_ts_ = false, size_t chunk_size_ = (1U << 20)) :
+				wmode(wmode_), chunk_size(chunk_size_), with_ts(with_ts_) {
+			wscale = pow(10.0,(double)wdigits);
+			cur = {0,0,0,0,0};
+			last_txid = 0;
+			last_ts = 0;
+		}
+
+		/* add one transaction; inputs and outputs are vectors of (address, value)
+		 * pairs with distinct addresses in increasing order, and sum is the total
+		 * of input values; ts is the timestamp of the transaction (only used if
+		 * timestamps are stored); returns the number of edges */
+		template<class vec_t>
+		uint64_t add_tx(uint32_t txid, const vec_t& inputs, const vec_t& outputs, uint32_t ts = 0) {
+			if(inputs.empty() || outputs.empty()) return 0;
+			if(cur.txs == 0) {
+				cur.min_txid = txid;
+				last_txid = txid;
+				last_ts = 0;
+			}
+			txedge_col_put_varint(s_tx,txid - last_txid);
+			txedge_col_put_varint(s_tx,inputs.size());
+			txedge_col_put_varint(s_tx,outputs.size());
+			if(with_ts) {
+				txedge_col_put_varint(s_tx,txedge_col_zigzag((int64_t)ts - (int64_t)last_ts));
+				last_ts = ts;
+			}
+			put_addrs(inputs);
+			put_addrs(outputs);
+			if(wmode == TXEDGE_COL_W_EXACT) {
+				for(const auto& x : inputs) txedge_col_put_varint(s_w,txedge_col_zigzag(x.second));
+				for(const auto& x : outputs) txedge_col_put_varint(s_w,txedge_col_zigzag(x.second));
+			}
+			else {
+				/* note: same computation as in txedge (tx_t::iterator) */
+				int64_t tmp = 0;
+				for(const auto& x : inputs) tmp += x.second;
+				double sum = (double)tmp;
+				for(const auto& x : inputs) for(const auto& y : outputs) {
+					double w = 0.0;
+					if(sum > 0.0) w = ((double)(x.second)) * (((double)(y.second)) / sum);
+					if(wmode == TXEDGE_COL_W_F32) {
+						float f = (float)w;
+						uint32_t u;
+						memcpy(&u,&f,4);
+						size_t pos = s_w.size();
+						s_w.resize(pos + 4);
+						txedge_bin_put32(s_w.data() + pos,u);
+					}
+					else {
+						/* weights that do not fit in 64-bit integers after scaling
+						 * cannot be stored (this is only possible if too many
+						 * digits were requested) */
+						double x = w*wscale;
+						if(!(fabs(x) < 9223372036854775807.0)) {
+							fprintf(stderr,"txedge_col_encoder: weight %g of transaction %u cannot be "
+								"stored with %d digits!\n",w,txid,(int)lround(log10(wscale)));
+							throw new std::runtime_error("txedge_col_encoder: weight out of range!\n");
+						}
+						txedge_col_put_varint(s_w,txedge_col_zigzag(llround(x)));
+					}
+				}
+			}
+			uint64_t edges = ((uint64_t)inputs.size())*((uint64_t)outputs.size());
+			cur.txs++;
+			cur.edges += edges;
+			cur.max_txid = txid;
+			last_txid = txid;
+			return edges;
+		}
+
+		/* true if the current chunk reached the target size */
+		bool chunk_full() const {
+			return s_tx.size() + s_addr.size() + s_w.size() >= chunk_size;
+		}
+
+		/* write the current chunk to o (buf_writer or mem_buf), and store its
+		 * information in idx; pos is the current position in the output
+		 * (i.e. the offset of the chunk), it is advanced by the size of the
+		 * chunk; does nothing if the chunk is empty */
+		template<class out_buf>
+		void finish_chunk(out_buf& o, std::vector<txedge_col_chunk_info>& idx, uint64_t& pos) {
+			if(cur.txs == 0) return;
+			cur.offset = pos;
+			pos += txedge_col_chunk_header_size + s_tx.size() + s_addr.size() + s_w.size();
+			char* p = o.reserve(txedge_col_chunk_header_size);
+			memset(p,0,txedge_col_chunk_header_size);
+			txedge_bin_put32(p,cur.txs);
+			txedge_bin_put64(p+8,cur.edges);
+			txedge_bin_put32(p+16,cur.min_txid);
+			txedge_bin_put32(p+20,cur.max_txid);
+			txedge_bin_put32(p+24,s_tx.size());
+			txedge_bin_put32(p+28,s_addr.size());
+			txedge_bin_put32(p+32,s_w.size());
+			o.commit(txedge_col_chunk_header_size);
+			o.write(s_tx.data(),s_tx.size());
+			o.write(s_addr.data(),s_addr.size());
+			o.write(s_w.data(),s_w.size());
+			idx.push_back(cur);
+			s_tx.clear();
+			s_addr.clear();
+			s_w.clear();
+			cur = {0,0,0,0,0};
+		}
+
+		/* size of a chunk in bytes (header and data) */
+		static uint64_t chunk_bytes(const char* chunk_header) {
+			return txedge_col_chunk_header_size + (uint64_t)txedge_bin_get32(chunk_header+24) +
+				(uint64_t)txedge_bin_get32(chunk_header+28) + (uint64_t)txedge_bin_get32(chunk_header+32);
+		}
+
+		/* write the file header to o */
+		template<class out_buf>
+		void write_header(out_buf& o) const {
+			char* p = o.reserve(txedge_col_header_size);
+			memset(p,0,txedge_col_header_size);
+			memcpy(p,txedge_col_magic,8);
+			txedge_bin_put32(p+8,txedge_col_version);
+			txedge_bin_put32(p+12,wmode);
+			txedge_bin_put32(p+16,(uint32_t)lround(log10(wscale)));
+			txedge_bin_put32(p+20,with_ts ? TXEDGE_COL_FLAG_TS : 0);
+			o.commit(txedge_col_header_size);
+		}
+
+		/* write the chunk index and the footer to o; idx should contain the
+		 * offset of all chunks; index_offset is the offset where the index
+		 * is written (i.e. the current size of the file) */
+		template<class out_buf>
+		static void write_index(out_buf& o, const std::vector<txedge_col_chunk_info>& idx, uint64_t index_offset) {
+			uint64_t edges = 0;
+			for(const auto& c : idx) {
+				char* p = o.reserve(txedge_col_index_entry_size);
+				memset(p,0,txedge_col_index_entry_size);
+				txedge_bin_put64(p,c.offset);
+				txedge_bin_put32(p+8,c.min_txid);
+				txedge_bin_put32(p+12,c.max_txid);
+				txedge_bin_put64(p+16,c.edges);
+				txedge_bin_put32(p+24,c.txs);
+				o.commit(txedge_col_index_entry_size);
+				edges += c.edges;
+			}
+			char* p = o.reserve(txedge_col_footer_size);
+			txedge_bin_put64(p,index_offset);
+			txedge_bin_put64(p+8,idx.size());
+			txedge_bin_put64(p+16,edges);
+			memcpy(p+24,txedge_col_magic,8);
+			o.commit(txedge_col_footer_size);
+		}
+};
+
+
+/* decoded edges of a chunk (struct of arrays) */
+struct txedge_col_edges {
+	std::vector<uint32_t> txid;
+	std::vector<int32_t> addr_in;
+	std::vector<int32_t> addr_out;
+	std::vector<double> w;
+	std::vector<uint32_t> ts; // only filled in if the file has timestamps
+	size_t size() const { return txid.size(); }
+	void clear() {
+		ts.clear();
+		txid.clear();
+		addr_in.clear();
+		addr_out.clear();
+		w.clear();
+	}
+};
+
+
+/* read a file by memory mapping it */
+class txedge_col_reader {
+	protected:
+		char* map;
+		size_t map_size;
+		txedge_col_wmode wmode;
+		double wscale;
+		bool with_ts;
+		std::vector<txedge_col_chunk_info> idx;
+		uint64_t total_edges;
+
+		/* temporary storage for decoding */
+		std::vector<std::pair<int32_t,int64_t> > tmp_in;
+		std::vector<std::pair<int32_t,int64_t> > tmp_out;
+
+		bool get_addrs(const char*& p, const char* end, uint64_t n, std::vector<std::pair<int32_t,int64_t> >& v) {
+			v.resize(n);
+			int64_t prev = 0;
+			for(uint64_t i=0;i<n;i++) {
+				uint64_t x;
+				if(!txedge_col_get_varint(p,end,x)) return false;
+				int64_t a = (i == 0) ? ((int64_t)x - 1) : (prev + (int64_t)x + 1);
+				if(a < -1 || a > INT32_MAX) return false;
+				v[i].first = (int32_t)a;
+				prev = a;
+			}
+			return true;
+		}
+
+	public:
+		txedge_col_reader() : map(0), map_size(0), wmode(TXEDGE_COL_W_EXACT), wscale(1.0), with_ts(false), total_edges(0) { }
+		~txedge_col_reader() { close(); }
+		txedge_col_reader(const txedge_col_reader&) = delete;
+		txedge_col_reader& operator = (const txedge_col_reader&) = delete;
+
+		/* open and map the given file, read the chunk index
+		 * returns false on error (an error message is written to stderr) */
+		bool open(const char* fn) {
+			close();
+			int fd = ::open(fn,O_RDONLY);
+			if(fd < 0) {
+				fprintf(stderr,"txedge_col_reader: cannot open file %s!\n",fn);
+				return false;
+			}
+			struct stat st;
+			if(fstat(fd,&st) || (size_t)st.st_size < txedge_col_header_size + txedge_col_footer_size) {
+				fprintf(stderr,"txedge_col_reader: invalid file %s!\n",fn);
+				::close(fd);
+				return false;
+			}
+			void* m = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+			::close(fd);
+			if(m == MAP_FAILED) {
+				fprintf(stderr,"txedge_col_reader: cannot map file %s!\n",fn);
+				return false;
+			}
+#ifdef MADV_SEQUENTIAL
+			madvise(m,st.st_size,MADV_SEQUENTIAL);
+#endif
+			map = (char*)m;
+			map_size = st.st_size;
+			const char* f = map + map_size - txedge_col_footer_size;
+			bool ok = !memcmp(map,txedge_col_magic,8) && txedge_bin_get32(map+8) == txedge_col_version &&
+				!memcmp(f+24,txedge_col_magic,8);
+			uint64_t index_offset = txedge_bin_get64(f);
+			uint64_t n = txedge_bin_get64(f+8);
+			if(ok) ok = (index_offset <= map_size - txedge_col_footer_size) &&
+				(n == (map_size - txedge_col_footer_size - index_offset) / txedge_col_index_entry_size);
+			if(ok) {
+				wmode = (txedge_col_wmode)txedge_bin_get32(map+12);
+				wscale = pow(10.0,(double)txedge_bin_get32(map+16));
+				with_ts = (txedge_bin_get32(map+20) & TXEDGE_COL_FLAG_TS) != 0;
+				total_edges = txedge_bin_get64(f+16);
+				idx.resize(n);
+				for(uint64_t i=0;i<n;i++) {
+					const char* p = map + index_offset + i*txedge_col_index_entry_size;
+					idx[i].offset = txedge_bin_get64(p);
+					idx[i].min_txid = txedge_bin_get32(p+8);
+					idx[i].max_txid = txedge_bin_get32(p+12);
+					idx[i].edges = txedge_bin_get64(p+16);
+					idx[i].txs = txedge_bin_get32(p+24);
+					if(idx[i].offset + txedge_col_chunk_header_size > index_offset ||
+						idx[i].offset + txedge_col_encoder::chunk_bytes(map + idx[i].offset) > index_offset) ok = false;
+				}
+			}
+			if(!ok) {
+				fprintf(stderr,"txedge_col_reader: invalid file %s!\n",fn);
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+			if(map) munmap(map,map_size);
+			map = 0;
+			map_size = 0;
+			idx.clear();
+			total_edges = 0;
+		}
+
+		size_t nchunks() const { return idx.size(); }
+		uint64_t size() const { return total_edges; }
+		uint32_t chunk_min_txid(size_t i) const { return idx[i].min_txid; }
+		uint32_t chunk_max_txid(size_t i) const { return idx[i].max_txid; }
+		uint64_t chunk_edges(size_t i) const { return idx[i].edges; }
+		/* true if transactions have timestamps */
+		bool has_ts() const { return with_ts; }
+
+		/* find the first chunk that can contain edges with txid >= the given
+		 * value (returns nchunks() if there is none) */
+		size_t find_chunk(uint32_t txid) const {
+			return std::lower_bound(idx.begin(),idx.end(),txid,
+				[](const txedge_col_chunk_info& c, uint32_t t) { return c.max_txid < t; }) - idx.begin();
+		}
+
+		/* decode all edges of chunk i, appending them to e
+		 * returns false if the chunk is invalid */
+		bool decode_chunk(size_t i, txedge_col_edges& e) {
+			const char* h = map + idx[i].offset;
+			uint32_t txs = txedge_bin_get32(h);
+			uint64_t edges = txedge_bin_get64(h+8);
+			uint32_t txid = txedge_bin_get32(h+16);
+			const char* p_tx = h + txedge_col_chunk_header_size;
+			const char* p_addr = p_tx + txedge_bin_get32(h+24);
+			const char* p_w = p_addr + txedge_bin_get32(h+28);
+			const char* end_tx = p_addr;
+			const char* end_addr = p_w;
+			const char* end_w = p_w + txedge_bin_get32(h+32);
+
+			size_t n0 = e.size();
+			e.txid.resize(n0 + edges);
+			e.addr_in.resize(n0 + edges);
+			e.addr_out.resize(n0 + edges);
+			e.w.resize(n0 + edges);
+			if(with_ts) e.ts.resize(n0 + edges);
+			size_t k = n0;
+			uint32_t ts = 0;
+
+			for(uint32_t t=0;t<txs;t++) {
+				uint64_t d, n_in, n_out;
+				if(!txedge_col_get_varint(p_tx,end_tx,d) || !txedge_col_get_varint(p_tx,end_tx,n_in) ||
+					!txedge_col_get_varint(p_tx,end_tx,n_out)) return false;
+				txid += (uint32_t)d;
+				if(with_ts) {
+					if(!txedge_col_get_varint(p_tx,end_tx,d)) return false;
+					ts += (uint32_t)txedge_col_unzigzag(d);
+				}
+				if(k + n_in*n_out > n0 + edges) return false;
+				if(!get_addrs(p_addr,end_addr,n_in,tmp_in) || !get_addrs(p_addr,end_addr,n_out,tmp_out)) return false;
+				double sum = 0.0;
+				if(wmode == TXEDGE_COL_W_EXACT) {
+					int64_t tmp = 0;
+					for(auto& x : tmp_in) {
+						uint64_t v;
+						if(!txedge_col_get_varint(p_w,end_w,v)) return false;
+						x.second = txedge_col_unzigzag(v);
+						tmp += x.second;
+					}
+					for(auto& x : tmp_out) {
+						uint64_t v;
+						if(!txedge_col_get_varint(p_w,end_w,v)) return false;
+						x.second = txedge_col_unzigzag(v);
+					}
+					sum = (double)tmp;
+				}
+				for(const auto& x : tmp_in) for(const auto& y : tmp_out) {
+					e.txid[k] = txid;
+					e.addr_in[k] = x.first;
+					e.addr_out[k] = y.first;
+					if(with_ts) e.ts[k] = ts;
+					double w = 0.0;
+					switch(wmode) {
+						case TXEDGE_COL_W_EXACT:
+							/* note: same computation as in txedge (tx_t::iterator) */
+							if(sum > 0.0) w = ((double)(x.second)) * (((double)(y.second)) / sum);
+							break;
+						case TXEDGE_COL_W_F32:
+							{
+								if(end_w - p_w < 4) return false;
+								uint32_t u = txedge_bin_get32(p_w);
+								float f;
+								memcpy(&f,&u,4);
+								w = f;
+								p_w += 4;
+							}
+							break;
+						default:
+							{
+								uint64_t v;
+								if(!txedge_col_get_varint(p_w,end_w,v)) return false;
+								w = ((double)txedge_col_unzigzag(v)) / wscale;
+							}
+							break;
+					}
+					e.w[k] = w;
+					k++;
+				}
+			}
+			return (k == n0 + edges);
+		}
+};
+
+#endif /* _TXEDGE_COL_H */
+
@@ -0,0 +1,428 @@
+/*  -*- C++ -*-
+ * txedge_csr.h -- binary file format for the aggregated address graph as
+ * 	compressed sparse rows (CSR), written by txedge -G; also includes a
+ * 	reader that memory maps the file
+ *
+ * nodes of the graph are addresses; to include the special address -1,
+ * node i corresponds to address i - 1; edges are the aggregated
+ * (addr_in, addr_out) pairs (see pair_agg.h) with their total weight
+ *
+ * format (all values are little-endian; all sections start at offsets
+ * that are multiples of 8):
+ * 	header (128 bytes):
+ * 		0: magic "TXEDGEG" + '\0'
+ * 		8: uint32 version (currently 1)
+ * 		12: uint32 flags (TXEDGE_CSR_FLAG_CSC: the transposed graph is included)
+ * 		16: uint64 number of nodes (n)
+ * 		24: uint64 number of edges (m)
+ * 		32: uint64 offset of the row offsets (CSR)
+ * 		40: uint64 offset of the targets (CSR)
+ * 		48: uint64 offset of the weights (CSR)
+ * 		56: uint64 offset of the column offsets (CSC, zero if not included)
+ * 		64: uint64 offset of the sources (CSC)
+ * 		72: uint64 offset of the weights (CSC)
+ * 		80-127: reserved (zero)
+ * 	row offsets: n + 1 uint64 values; edges from node i are at positions
+ * 		[offsets[i], offsets[i+1]) in the following arrays
+ * 	targets: m uint32 values (target nodes, in increasing order in each row)
+ * 	weights: m double values
+ * 	if TXEDGE_CSR_FLAG_CSC is set: the same three arrays for the transposed
+ * 		graph (i.e. edges to node i, with the source nodes in increasing order)
+ *
+ * example usage:
+
+txedge_csr_reader r;
+if(!r.open("graph.csr")) ... // handle error
+for(uint64_t i=0;i<r.nodes();i++)
+	for(uint64_t j=r.row_offsets()[i];j<r.row_offsets()[i+1];j++)
+		... // edge from node i (address i-1) to r.targets()[j] with weight r.weights()[j]
+
+ * note: the reader and writer only support little-endian systems, since
+ * arrays are accessed directly in the memory mapped file
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TXEDGE_CSR_H
+#define _TXEDGE_CSR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include "txedge_bin.h" // txedge_bin_put32() and similar
+
+
+static const char txedge_csr_magic[8] = {'T','X','E','D','G','E','G',0};
+static const uint32_t txedge_csr_version = 1;
+static const size_t txedge_csr_header_size = 128;
+static const uint32_t TXEDGE_CSR_FLAG_CSC = 1;
+
+
+/* run f(start, end) on nthreads parts of the range [0, n) in parallel */
+template<class F>
+static void txedge_csr_parallel(uint64_t n, unsigned int nthreads, F f) {
+	if(nthreads < 2) {
+		f((uint64_t)0,n);
+		return;
+	}
+	std::vector<std::thread> th;
+	for(unsigned int i=0;i<nthreads;i++) {
+		uint64_t start = (n * i) / nthreads;
+		uint64_t end = (n * (i+1)) / nthreads;
+		th.emplace_back(f,start,end);
+	}
+	for(auto& t : th) t.join();
+}
+
+/* transpose a graph in CSR format with n nodes (off has n + 1 elements),
+ * using parallel counting of the in-degrees, a prefix sum and scattering
+ * the edges; the sources in each row of the result are in increasing order */
+static void txedge_csr_transpose(uint64_t n, const uint64_t* off, const uint32_t* tgt, const double* w,
+		unsigned int nthreads, std::vector<uint64_t>& t_off, std::vector<uint32_t>& t_src, std::vector<double>& t_w) {
+	uint64_t m = off[n];
+	if(m < 65536) nthreads = 1; // not worth using threads
+	/* split the rows so that each thread has about the same number of edges */
+	std::vector<uint64_t> row_split(nthreads + 1,n);
+	row_split[0] = 0;
+	for(unsigned int i=1;i<nthreads;i++)
+		row_split[i] = std::upper_bound(off,off+n,(m*i)/nthreads) - off;
+	auto by_edges = [&](auto f) {
+		txedge_csr_parallel(nthreads,nthreads,[&](uint64_t a, uint64_t b) {
+			for(uint64_t k=a;k<b;k++) f(row_split[k],row_split[k+1]);
+		});
+	};
+
+	/* 1. count edges to each node */
+	std::vector<std::atomic<uint64_t> > cnt(n + 1);
+	txedge_csr_parallel(n+1,nthreads,[&cnt](uint64_t a, uint64_t b) {
+		for(uint64_t i=a;i<b;i++) cnt[i].store(0,std::memory_order_relaxed);
+	});
+	by_edges([&](uint64_t a, uint64_t b) {
+		for(uint64_t j=off[a];j<off[b];j++) cnt[tgt[j]].fetch_add(1,std::memory_order_relaxed);
+	});
+
+	/* 2. exclusive prefix sum: sums of blocks first, then each block */
+	t_off.resize(n + 1);
+	std::vector<uint64_t> block_sum(nthreads + 1,0);
+	txedge_csr_parallel(nthreads,nthreads,[&](uint64_t a, uint64_t b) {
+		for(uint64_t k=a;k<b;k++) {
+			uint64_t s = 0;
+			for(uint64_t i=(n*k)/nthreads;i<(n*(k+1))/nthreads;i++) s += cnt[i].load(std::memory_order_relaxed);
+			block_sum[k+1] = s;
+		}
+	});
+	for(unsigned int k=0;k<nthreads;k++) block_sum[k+1] += block_sum[k];
+	txedge_csr_parallel(nthreads,nthreads,[&](uint64_t a, uint64_t b) {
+		for(uint64_t k=a;k<b;k++) {
+			uint64_t s = block_sum[k];
+			for(uint64_t i=(n*k)/nthreads;i<(n*(k+1))/nthreads;i++) {
+				uint64_t c = cnt[i].load(std::memory_order_relaxed);
+				t_off[i] = s;
+				cnt[i].store(s,std::memory_order_relaxed); // position to write the next edge
+				s += c;
+			}
+		}
+	});
+	t_off[n] = m;
+
+	/* 3. scatter the edges */
+	t_src.resize(m);
+	t_w.resize(m);
+	by_edges([&](uint64_t a, uint64_t b) {
+		for(uint64_t i=a;i<b;i++) for(uint64_t j=off[i];j<off[i+1];j++) {
+			uint64_t pos = cnt[tgt[j]].fetch_add(1,std::memory_order_relaxed);
+			t_src[pos] = (uint32_t)i;
+			t_w[pos] = w[j];
+		}
+	});
+
+	/* 4. sort the sources in each row (the order after scattering depends
+	 * on the threads, each thread processed sources in increasing order) */
+	txedge_csr_parallel(n,nthreads,[&](uint64_t a, uint64_t b) {
+		std::vector<std::pair<uint32_t,double> > tmp;
+		for(uint64_t i=a;i<b;i++) {
+			uint64_t s = t_off[i], e = t_off[i+1];
+			if(std::is_sorted(t_src.begin()+s,t_src.begin()+e)) continue;
+			tmp.clear();
+			for(uint64_t j=s;j<e;j++) tmp.push_back(std::make_pair(t_src[j],t_w[j]));
+			std::sort(tmp.begin(),tmp.end());
+			for(uint64_t j=s;j<e;j++) {
+				t_src[j] = tmp[j-s].first;
+				t_w[j] = tmp[j-s].second;
+			}
+		}
+	});
+}
+
+
+/* write a file with edges given in order of (addr_in, addr_out); targets
+ * are written directly to the file, weights are stored in a temporary file
+ * and copied after them, while row offsets are kept in memory */
+class txedge_csr_writer {
+	protected:
+		FILE* f;
+		FILE* tmp; // weights
+		const char* fn;
+		std::vector<uint64_t> off;
+		uint64_t m;
+		uint64_t max_node; // largest target node
+		bool error;
+
+		static bool pad8(FILE* f) {
+			static const char zeros[8] = {0,0,0,0,0,0,0,0};
+			long pos = ftell(f);
+			if(pos < 0) return false;
+			size_t len = (8 - (pos % 8)) % 8;
+			return fwrite(zeros,1,len,f) == len;
+		}
+
+	public:
+		txedge_csr_writer() : f(0), tmp(0), fn(0), m(0), max_node(0), error(false) { }
+		~txedge_csr_writer() { close(); }
+		txedge_csr_writer(const txedge_csr_writer&) = delete;
+		txedge_csr_writer& operator = (const txedge_csr_writer&) = delete;
+
+		/* create the file fn; temporary data is stored in tmpdir
+		 * returns false on error (an error message is written to stderr) */
+		bool open(const char* fn_, const char* tmpdir = "/tmp") {
+			close();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+			fprintf(stderr,"txedge_csr_writer: only little-endian systems are supported!\n");
+			return false;
+#endif
+			fn = fn_;
+			f = fopen(fn,"w+b");
+			if(!f) {
+				fprintf(stderr,"txedge_csr_writer: cannot open file %s!\n",fn);
+				return false;
+			}
+			std::string tmp_fn = std::string(tmpdir) + "/txedge_csrXXXXXX";
+			int fd = mkstemp(&tmp_fn[0]);
+			if(fd >= 0) {
+				unlink(tmp_fn.c_str());
+				tmp = fdopen(fd,"w+b");
+				if(!tmp) ::close(fd);
+			}
+			if(!tmp) {
+				fprintf(stderr,"txedge_csr_writer: cannot create temporary file in %s!\n",tmpdir);
+				close();
+				return false;
+			}
+			setvbuf(f,0,_IOFBF,1U << 22);
+			setvbuf(tmp,0,_IOFBF,1U << 22);
+			char h[txedge_csr_header_size];
+			memset(h,0,txedge_csr_header_size);
+			error = (fwrite(h,1,txedge_csr_header_size,f) != txedge_csr_header_size);
+			m = 0;
+			max_node = 0;
+			off.clear();
+			return !error;
+		}
+
+		void close() {
+			if(f) fclose(f);
+			if(tmp) fclose(tmp);
+			f = 0;
+			tmp = 0;
+		}
+
+		/* add one edge; edges should be added in order of (addr_in, addr_out) */
+		void add(int32_t addr_in, int32_t addr_out, double w) {
+			uint64_t src = (uint64_t)((int64_t)addr_in + 1);
+			uint32_t dst = (uint32_t)((int64_t)addr_out + 1);
+			while(off.size() <= src) off.push_back(m);
+			if(dst > max_node) max_node = dst;
+			if(fwrite(&dst,4,1,f) != 1 || fwrite(&w,8,1,tmp) != 1) error = true;
+			m++;
+		}
+
+		uint64_t edges() const { return m; }
+
+		/* write the rest of the file and close it; if with_csc == true, the
+		 * transposed graph is included as well, created using nthreads
+		 * threads; returns false on error */
+		bool finish(bool with_csc, unsigned int nthreads = 1) {
+			if(!f) return false;
+			if(nthreads == 0) nthreads = 1;
+			uint64_t n = std::max((uint64_t)off.size(),max_node + 1);
+			off.resize(n + 1,m);
+			uint64_t h_off[6] = {0,0,0,0,0,0};
+			h_off[1] = txedge_csr_header_size;
+			/* weights after the targets */
+			if(!error && !pad8(f)) error = true;
+			h_off[2] = ftell(f);
+			if(!error && (fflush(tmp) || fseek(tmp,0,SEEK_SET))) error = true;
+			if(!error) {
+				std::vector<char> buf(1U << 20);
+				size_t len;
+				while((len = fread(buf.data(),1,buf.size(),tmp)) > 0)
+					if(fwrite(buf.data(),1,len,f) != len) { error = true; break; }
+				if(ferror(tmp)) error = true;
+			}
+			fclose(tmp);
+			tmp = 0;
+			/* row offsets */
+			h_off[0] = ftell(f);
+			if(!error && fwrite(off.data(),8,n+1,f) != n+1) error = true;
+			if(!error && with_csc) {
+				/* map the CSR arrays written so far for transposing them */
+				if(fflush(f)) error = true;
+				size_t map_size = h_off[0] + 8*(n+1);
+				void* map = error ? MAP_FAILED : mmap(0,map_size,PROT_READ,MAP_SHARED,fileno(f),0);
+				if(map == MAP_FAILED) error = true;
+				else {
+					const char* p = (const char*)map;
+					std::vector<uint64_t> t_off;
+					std::vector<uint32_t> t_src;
+					std::vector<double> t_w;
+					txedge_csr_transpose(n,(const uint64_t*)(p + h_off[0]),(const uint32_t*)(p + h_off[1]),
+						(const double*)(p + h_off[2]),nthreads,t_off,t_src,t_w);
+					munmap(map,map_size);
+					if(fseek(f,0,SEEK_END)) error = true;
+					h_off[3] = ftell(f);
+					if(!error && fwrite(t_off.data(),8,n+1,f) != n+1) error = true;
+					h_off[4] = ftell(f);
+					if(!error && fwrite(t_src.data(),4,m,f) != m) error = true;
+					if(!error && !pad8(f)) error = true;
+					h_off[5] = ftell(f);
+					if(!error && fwrite(t_w.data(),8,m,f) != m) error = true;
+				}
+			}
+			/* header last */
+			char h[txedge_csr_header_size];
+			memset(h,0,txedge_csr_header_size);
+			memcpy(h,txedge_csr_magic,8);
+			txedge_bin_put32(h+8,txedge_csr_version);
+			txedge_bin_put32(h+12,with_csc ? TXEDGE_CSR_FLAG_CSC : 0);
+			txedge_bin_put64(h+16,n);
+			txedge_bin_put64(h+24,m);
+			for(int i=0;i<6;i++) txedge_bin_put64(h+32+8*i,h_off[i]);
+			if(!error && (fseek(f,0,SEEK_SET) || fwrite(h,1,txedge_csr_header_size,f) != txedge_csr_header_size)) error = true;
+			if(fclose(f)) error = true;
+			f = 0;
+			if(error) fprintf(stderr,"txedge_csr_writer: error writing file %s!\n",fn);
+			return !error;
+		}
+};
+
+
+/* read a file by memory mapping it */
+class txedge_csr_reader {
+	protected:
+		char* map;
+		size_t map_size;
+		uint32_t flags;
+		uint64_t n;
+		uint64_t m;
+		uint64_t sec[6]; // offsets of the arrays
+
+	public:
+		txedge_csr_reader() : map(0), map_size(0), flags(0), n(0), m(0) { }
+		~txedge_csr_reader() { close(); }
+		txedge_csr_reader(const txedge_csr_reader&) = delete;
+		txedge_csr_reader& operator = (const txedge_csr_reader&) = delete;
+
+		/* open and map the given file, check the header
+		 * returns false on error (an error message is written to stderr) */
+		bool open(const char* fn) {
+			close();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+			fprintf(stderr,"txedge_csr_reader: only little-endian systems are supported!\n");
+			return false;
+#endif
+			int fd = ::open(fn,O_RDONLY);
+			if(fd < 0) {
+				fprintf(stderr,"txedge_csr_reader: cannot open file %s!\n",fn);
+				return false;
+			}
+			struct stat st;
+			if(fstat(fd,&st) || (size_t)st.st_size < txedge_csr_header_size) {
+				fprintf(stderr,"txedge_csr_reader: invalid file %s!\n",fn);
+				::close(fd);
+				return false;
+			}
+			void* mp = mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+			::close(fd);
+			if(mp == MAP_FAILED) {
+				fprintf(stderr,"txedge_csr_reader: cannot map file %s!\n",fn);
+				return false;
+			}
+			map = (char*)mp;
+			map_size = st.st_size;
+			bool ok = !memcmp(map,txedge_csr_magic,8) && txedge_bin_get32(map+8) == txedge_csr_version;
+			flags = txedge_bin_get32(map+12);
+			n = txedge_bin_get64(map+16);
+			m = txedge_bin_get64(map+24);
+			for(int i=0;i<6;i++) sec[i] = txedge_bin_get64(map+32+8*i);
+			/* check that all arrays are within the file */
+			uint64_t sizes[6] = {8*(n+1), 4*m, 8*m, 8*(n+1), 4*m, 8*m};
+			int nsec = (flags & TXEDGE_CSR_FLAG_CSC) ? 6 : 3;
+			for(int i=0;i<nsec && ok;i++)
+				if(sec[i] % 8 || sec[i] < txedge_csr_header_size || sec[i] > map_size || sizes[i] > map_size - sec[i]) ok = false;
+			if(ok && (row_offsets()[n] != m || (has_csc() && col_offsets()[n] != m))) ok = false;
+			if(!ok) {
+				fprintf(stderr,"txedge_csr_reader: invalid file %s!\n",fn);
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+			if(map) munmap(map,map_size);
+			map = 0;
+			map_size = 0;
+			n = 0;
+			m = 0;
+			flags = 0;
+		}
+
+		uint64_t nodes() const { return n; }
+		uint64_t edges() const { return m; }
+		bool has_csc() const { return (flags & TXEDGE_CSR_FLAG_CSC) != 0; }
+
+		/* arrays of the graph (n + 1 offsets, m targets and weights) */
+		const uint64_t* row_offsets() const { return (const uint64_t*)(map + sec[0]); }
+		const uint32_t* targets() const { return (const uint32_t*)(map + sec[1]); }
+		const double* weights() const { return (const double*)(map + sec[2]); }
+		/* arrays of the transposed graph (only if has_csc()) */
+		const uint64_t* col_offsets() const { return (const uint64_t*)(map + sec[3]); }
+		const uint32_t* sources() const { return (const uint32_t*)(map + sec[4]); }
+		const double* col_weights() const { return (const double*)(map + sec[5]); }
+
+		/* helpers for converting between nodes and addresses */
+		static int32_t node_to_addr(uint32_t i) { return (int32_t)((int64_t)i - 1); }
+		static uint32_t addr_to_node(int32_t a) { return (uint32_t)((int64_t)a + 1); }
+};
+
+#endif /* _TXEDGE_CSR_H */
+
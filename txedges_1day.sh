@@ -13,9 +13,13 @@ cd ..
 # download and compile the transaction matching program
 # git clone https://github.com/dkondor/txedges.git
 # cd txedges
-# g++ -o txedge txedge.cpp -std=gnu++14 -O3 -march=native
+# g++ -o txedge txedge.cpp -std=gnu++17 -O3 -march=native -llzma -lz -lpthread
 # cd ..
 
+# note: steps 2-6 can be replaced by running txedge directly on the full data files
+# with a time window, which adds the timestamps as well:
+# ./txedges/txedge -ix txin.dat.xz -ox txout.dat.xz -tx tx.dat.xz -hz bh.dat.gz -R $ts_start,(math $ts_start + 86400) > txedges_ts_$day.dat
+
 # 1. set which day we're interested in
 set day 2018-02-07 # or day=2018-02-07 in bash
 set ts_start (date -d $day -u +%s) # or ts_start=`date -d $day -u +%s` in bash
@@ -56,6 +60,8 @@ xzcat txout.dat.xz | ./join-utils/numjoin -o1 "" txids_$day.dat - > txout_$day.d
 # Matched lines from file 1: 213578
 # Matched lines from file 2: 2163171
 # Total lines output: 2163171
+# (alternatively, txedge can add the timestamps directly in step 5:
+# ./txedges/txedge -i txin_$day.dat -o txout_$day.dat -tx tx.dat.xz -hz bh.dat.gz > txedges_ts_$day.dat )
 
 
 
@@ -69,6 +75,9 @@ xzcat txout.dat.xz | ./join-utils/numjoin -o1 "" txids_$day.dat - > txout_$day.d
 # Matched lines from file 1: 141
 # Matched lines from file 2: 294
 # Total lines output: 294
+# (alternatively, txedge can write these in the same pass as step 5, with
+# the timestamps added as well:
+# ./txedges/txedge -i txin_$day.dat -o txout_$day.dat -tx tx.dat.xz -hz bh.dat.gz -M tx_mining_ts_$day.dat > txedges_ts_$day.dat )
 
 
 
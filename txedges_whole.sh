@@ -29,6 +29,9 @@ rm txout.fifo
 
 # 1.1. create unique edges from the previous
 awk 'BEGIN{OFS="\t";}{if($2!=$3) print $2,$3;}' edges.dat | sort -k 1n,1 -k 2n,2 -S 64G | uniq > edges_uniq.dat
+# (alternatively, txedge can aggregate edges directly, giving the total weight,
+# number of transactions and first and last txID for each unique edge as well:
+# ./txedges/txedge -ix txin.dat.xz -ox txout.dat.xz -As -m 16384 > edges_uniq.dat )
 
 # 1.2. add timestamps to the list of all edges
 gunzip bh.dat.gz
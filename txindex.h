@@ -0,0 +1,353 @@
+/*  -*- C++ -*-
+ * txindex.h -- sparse index of input files sorted by txid, so that reading
+ * 	can start close to a given txid instead of at the beginning of the file
+ *
+ * for xz compressed files, checkpoints are the beginnings of the blocks in
+ * the file, so files need to be compressed with multiple blocks (e.g. with
+ * xz -T0 or xz --block-size=64MiB) and as one stream; decompression can
+ * then start at any block (see xz_input::seek_block() in zinput.h)
+ * for uncompressed files, checkpoints are placed every 16 MiB
+ * gzip compressed files are not supported
+ *
+ * the index is a text file with tab-separated columns:
+ * 	first line: "txedge_index", version (2), size, modification time
+ * 		(seconds and nanoseconds) and inode number of the indexed file,
+ * 		offset of the xz stream index (0 for uncompressed files),
+ * 		size of the uncompressed data
+ * 	one line for each checkpoint: txid of the first line starting in the
+ * 		block, offset of the block, offset of the block in the uncompressed
+ * 		data, offset of the line in the uncompressed data
+ *
+ * example usage:
+
+tx_index::build("txin.dat.xz",true,0,"txin.dat.xz.idx");
+...
+tx_index idx;
+if(idx.read("txin.dat.xz.idx","txin.dat.xz")) {
+	const tx_index_entry* e = idx.find(txid);
+	if(e) ... // e.g. xz_input::seek_block(e->block_offset,idx.get_index_offset(),
+		// idx.get_size() - e->block_uoffset,e->line_uoffset - e->block_uoffset)
+}
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _TXINDEX_H
+#define _TXINDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <lzma.h>
+#include "zinput.h"
+
+
+/* properties of the indexed file, used to check that it has not changed */
+struct tx_index_file_info {
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t ino;
+	
+	bool operator == (const tx_index_file_info& x) const {
+		return size == x.size && mtime_sec == x.mtime_sec && mtime_nsec == x.mtime_nsec && ino == x.ino;
+	}
+};
+
+struct tx_index_entry {
+	uint32_t txid; // txid of the first line starting in the block
+	uint64_t block_offset; // offset of the block in the file
+	uint64_t block_uoffset; // offset of the block in the uncompressed data
+	uint64_t line_uoffset; // offset of the line in the uncompressed data
+};
+
+
+class tx_index {
+	protected:
+		std::vector<tx_index_entry> entries;
+		tx_index_file_info info;
+		uint64_t file_size;
+		uint64_t index_offset;
+		uint64_t usize;
+
+		static bool get_file_size(const char* fn, uint64_t& size) {
+			tx_index_file_info x;
+			if(!get_file_info(fn,x)) return false;
+			size = x.size;
+			return true;
+		}
+		static bool get_file_info(const char* fn, tx_index_file_info& x) {
+			struct stat st;
+			if(stat(fn,&st) || !S_ISREG(st.st_mode)) return false;
+			x.size = st.st_size;
+			x.mtime_sec = st.st_mtim.tv_sec;
+			x.mtime_nsec = st.st_mtim.tv_nsec;
+			x.ino = st.st_ino;
+			return true;
+		}
+
+		/* get the list of blocks in an xz file from its stream index
+		 * (blocks contain the offset and uncompressed offset of each block) */
+		static bool xz_blocks(const char* fn, std::vector<std::pair<uint64_t,uint64_t> >& blocks,
+				uint64_t& index_offset, uint64_t& usize) {
+			uint64_t size;
+			if(!get_file_size(fn,size) || size < 2*LZMA_STREAM_HEADER_SIZE) return false;
+			FILE* f = fopen(fn,"rb");
+			if(!f) return false;
+			bool ret = false;
+			uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+			lzma_stream_flags flags;
+			lzma_index* idx = 0;
+			std::vector<uint8_t> buf;
+			do {
+				if(fseeko(f,(off_t)(size - LZMA_STREAM_HEADER_SIZE),SEEK_SET) ||
+					fread(footer,1,LZMA_STREAM_HEADER_SIZE,f) != LZMA_STREAM_HEADER_SIZE) break;
+				if(lzma_stream_footer_decode(&flags,footer) != LZMA_OK) break;
+				if(flags.backward_size > size - 2*LZMA_STREAM_HEADER_SIZE) break;
+				index_offset = size - LZMA_STREAM_HEADER_SIZE - flags.backward_size;
+				buf.resize(flags.backward_size);
+				if(fseeko(f,(off_t)index_offset,SEEK_SET) ||
+					fread(buf.data(),1,buf.size(),f) != buf.size()) break;
+				uint64_t memlimit = UINT64_MAX;
+				size_t pos = 0;
+				if(lzma_index_buffer_decode(&idx,&memlimit,0,buf.data(),&pos,buf.size()) != LZMA_OK) break;
+				/* only files with one stream are supported */
+				if(LZMA_STREAM_HEADER_SIZE + lzma_index_total_size(idx) != index_offset) break;
+				usize = lzma_index_uncompressed_size(idx);
+				lzma_index_iter it;
+				lzma_index_iter_init(&it,idx);
+				blocks.clear();
+				while(!lzma_index_iter_next(&it,LZMA_INDEX_ITER_BLOCK))
+					blocks.push_back(std::make_pair(it.block.compressed_file_offset,it.block.uncompressed_file_offset));
+				ret = true;
+			} while(0);
+			if(idx) lzma_index_end(idx,0);
+			fclose(f);
+			return ret;
+		}
+
+		/* parse the txid in the given column from a line
+		 * returns false if it is not a valid number */
+		static bool parse_txid(const std::string& line, unsigned int txid_col, uint32_t& txid) {
+			const char* p = line.c_str();
+			for(unsigned int i=0;;i++) {
+				while(*p == ' ' || *p == '\t') p++;
+				if(i == txid_col) break;
+				while(*p && *p != ' ' && *p != '\t') p++;
+			}
+			if(*p < '0' || *p > '9') return false;
+			char* end;
+			unsigned long x = strtoul(p,&end,10);
+			if(x > UINT32_MAX || (*end && *end != ' ' && *end != '\t' && *end != '\r')) return false;
+			txid = (uint32_t)x;
+			return true;
+		}
+
+	public:
+		/* distance between checkpoints in uncompressed files */
+		static const uint64_t plain_step = (1ULL << 24);
+
+		tx_index() : info(), file_size(0), index_offset(0), usize(0) { }
+
+		/* build the index for the file fn (xz compressed if is_xz == true,
+		 * uncompressed otherwise), where the txid is in column txid_col
+		 * (0-based); the whole file is read (decompressed using the given
+		 * number of threads), the index is written to idx_fn
+		 * returns false on error (an error message is written to stderr) */
+		static bool build(const char* fn, bool is_xz, unsigned int txid_col, const char* idx_fn, unsigned int threads = 0) {
+			std::vector<std::pair<uint64_t,uint64_t> > blocks;
+			tx_index_file_info info;
+			uint64_t index_offset = 0;
+			uint64_t usize = 0;
+			if(!get_file_info(fn,info)) {
+				fprintf(stderr,"tx_index::build(): %s is not a regular file!\n",fn);
+				return false;
+			}
+			uint64_t file_size = info.size;
+			if(is_xz) {
+				if(!xz_blocks(fn,blocks,index_offset,usize)) {
+					fprintf(stderr,"tx_index::build(): cannot read the index of %s (only xz files with one stream are supported)!\n",fn);
+					return false;
+				}
+				if(blocks.size() < 2) fprintf(stderr,"tx_index::build(): Warning: %s has only one block!\n",fn);
+			}
+			else {
+				usize = file_size;
+				for(uint64_t x = 0; x < file_size; x += plain_step) blocks.push_back(std::make_pair(x,x));
+			}
+
+			FILE* f = 0;
+			zinput* z = 0;
+			if(is_xz) z = zinput::open(fn,zinput::xz,threads);
+			else {
+				f = fopen(fn,"rb");
+				if(!f) fprintf(stderr,"tx_index::build(): error opening file %s!\n",fn);
+			}
+			FILE* out = fopen(idx_fn,"w");
+			if(!out) fprintf(stderr,"tx_index::build(): error opening output file %s!\n",idx_fn);
+			bool ret = (f || z) && out;
+			if(ret) fprintf(out,"txedge_index\t2\t%lu\t%ld\t%ld\t%lu\t%lu\t%lu\n",(unsigned long)file_size,
+				(long)info.mtime_sec,(long)info.mtime_nsec,(unsigned long)info.ino,index_offset,usize);
+
+			/* read the data, find the first line starting in each block */
+			const size_t buf_size = (1U << 22);
+			std::vector<char> buf(ret ? buf_size : 0);
+			uint64_t pos = 0; // offset of buf in the uncompressed data
+			size_t bi = 0; // next block to find the first line for
+			bool in_line = false; // reading the first line of a block
+			uint64_t line_start = 0;
+			std::string line;
+			while(ret && bi < blocks.size()) {
+				ssize_t n = z ? z->read(buf.data(),buf_size) : (ssize_t)fread(buf.data(),1,buf_size,f);
+				if(n < 0 || (f && ferror(f))) {
+					fprintf(stderr,"tx_index::build(): error reading file %s!\n",fn);
+					ret = false;
+					break;
+				}
+				if(n == 0) break;
+				size_t i = 0;
+				while(i < (size_t)n && bi < blocks.size()) {
+					if(in_line) {
+						const char* e = (const char*)memchr(buf.data() + i,'\n',n - i);
+						size_t end = e ? (e - buf.data()) : n;
+						line.append(buf.data() + i,end - i);
+						i = end;
+						if(!e) continue;
+						uint32_t txid;
+						if(parse_txid(line,txid_col,txid))
+							fprintf(out,"%u\t%lu\t%lu\t%lu\n",txid,blocks[bi].first,blocks[bi].second,line_start);
+						in_line = false;
+						bi++;
+						continue;
+					}
+					/* the first line starting at or after the block start */
+					uint64_t target = blocks[bi].second;
+					if(target == 0) {
+						line_start = 0;
+						in_line = true;
+						line.clear();
+						continue;
+					}
+					if(pos + n < target) { i = n; continue; }
+					size_t j = i;
+					if(target - 1 >= pos) j = std::max(i,(size_t)(target - 1 - pos));
+					const char* e = (const char*)memchr(buf.data() + j,'\n',n - j);
+					if(!e) { i = n; continue; }
+					i = (e - buf.data()) + 1;
+					line_start = pos + i;
+					in_line = true;
+					line.clear();
+				}
+				pos += n;
+			}
+			if(ret && in_line) {
+				/* last line without a newline */
+				uint32_t txid;
+				if(parse_txid(line,txid_col,txid))
+					fprintf(out,"%u\t%lu\t%lu\t%lu\n",txid,blocks[bi].first,blocks[bi].second,line_start);
+			}
+			if(out && fclose(out)) {
+				fprintf(stderr,"tx_index::build(): error writing output file %s!\n",idx_fn);
+				ret = false;
+			}
+			if(f) fclose(f);
+			if(z) delete z;
+			return ret;
+		}
+
+		/* read the index from idx_fn, checking that it matches the file fn
+		 * (i.e. its size, modification time and inode number are the same
+		 * as when the index was created)
+		 * returns false if the index does not exist or is invalid (an error
+		 * message is written to stderr in the latter case) */
+		bool read(const char* idx_fn, const char* fn) {
+			entries.clear();
+			FILE* f = fopen(idx_fn,"r");
+			if(!f) return false;
+			unsigned int version = 0;
+			if(fscanf(f,"txedge_index\t%u",&version) == 1 && version != 2) {
+				fprintf(stderr,"tx_index::read(): index %s was created by an older version, it should be rebuilt (with -X)!\n",idx_fn);
+				fclose(f);
+				return false;
+			}
+			unsigned long a, b, c, ino;
+			long sec, nsec;
+			bool ret = (fscanf(f,"\t%lu\t%ld\t%ld\t%lu\t%lu\t%lu",&a,&sec,&nsec,&ino,&b,&c) == 6 && version == 2);
+			info.size = a;
+			info.mtime_sec = sec;
+			info.mtime_nsec = nsec;
+			info.ino = ino;
+			file_size = a;
+			index_offset = b;
+			usize = c;
+			tx_index_file_info cur;
+			if(ret && !(get_file_info(fn,cur) && cur == info)) {
+				fprintf(stderr,"tx_index::read(): index %s does not match the file %s!\n",idx_fn,fn);
+				fclose(f);
+				return false;
+			}
+			while(ret) {
+				tx_index_entry e;
+				unsigned long d;
+				int n = fscanf(f,"%u\t%lu\t%lu\t%lu",&e.txid,&a,&b,&d);
+				if(n == EOF) break;
+				e.block_offset = a;
+				e.block_uoffset = b;
+				e.line_uoffset = d;
+				if(n != 4 || e.line_uoffset < e.block_uoffset || e.line_uoffset > usize ||
+					(entries.size() && e.txid < entries.back().txid)) ret = false;
+				else entries.push_back(e);
+			}
+			fclose(f);
+			if(!ret) {
+				fprintf(stderr,"tx_index::read(): invalid index file %s!\n",idx_fn);
+				entries.clear();
+			}
+			return ret;
+		}
+
+		/* find the last checkpoint before the given txid, i.e. all lines
+		 * with this txid are after it (returns 0 if there is none) */
+		const tx_index_entry* find(uint32_t txid) const {
+			auto it = std::lower_bound(entries.begin(),entries.end(),txid,
+				[](const tx_index_entry& e, uint32_t t) { return e.txid < t; });
+			if(it == entries.begin()) return 0;
+			--it;
+			return &(*it);
+		}
+
+		/* true if the index is for an xz file */
+		bool is_xz() const { return index_offset != 0; }
+		/* offset of the xz stream index (i.e. the end of the last block) */
+		uint64_t get_index_offset() const { return index_offset; }
+		/* size of the uncompressed data */
+		uint64_t get_size() const { return usize; }
+};
+
+#endif /* _TXINDEX_H */
+
@@ -0,0 +1,300 @@
+/*  -*- C++ -*-
+ * zinput.h -- in-process decompression of gzip and xz compressed input
+ * 	files, supplying data in large blocks (e.g. to read_table)
+ *
+ * requires zlib and liblzma (link with -lz -llzma); with liblzma >= 5.4,
+ * xz files consisting of multiple blocks (e.g. created with xz -T0) are
+ * decompressed using multiple threads; decompression of such files can also
+ * start at any block (see xz_input::seek_block())
+ *
+ * example usage:
+
+zinput* z = zinput::open(fn,zinput::xz);
+if(!z) ... // handle error
+read_table2 r((FILE*)0);
+r.use_reader(zinput::read_cb,z);
+while(r.read_line()) { ... }
+delete z;
+
+ *
+ * Copyright 2018 Daniel Kondor <kondor.dani@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _ZINPUT_H
+#define _ZINPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include <lzma.h>
+
+
+/* base class: decompressed data can be read with read() */
+class zinput {
+	public:
+		enum ztype { gzip, xz };
+
+		/* read at most len bytes of decompressed data into buf
+		 * returns the number of bytes read, 0 at the end of the input and
+		 * -1 on error (an error message is written to stderr as well) */
+		virtual ssize_t read(char* buf, size_t len) = 0;
+		virtual ~zinput() { }
+
+		/* position in the compressed file, i.e. the amount of compressed
+		 * data read so far (including any data skipped at the start)
+		 * note: this can be ahead of the data returned because of buffering */
+		virtual uint64_t in_pos() const = 0;
+
+		/* callback that can be given to read_table_set_reader() */
+		static ssize_t read_cb(void* ctx, char* buf, size_t len) {
+			return ((zinput*)ctx)->read(buf,len);
+		}
+
+		/* open the given file for decompression
+		 * threads: number of threads to use for xz (0: number of CPUs)
+		 * returns 0 on error (an error message is written to stderr) */
+		static zinput* open(const char* fn, ztype type, unsigned int threads = 0);
+};
+
+
+/* gzip input using zlib (concatenated gzip files are handled as well) */
+class gz_input : public zinput {
+	protected:
+		gzFile gz;
+		const char* fn;
+	public:
+		explicit gz_input(const char* fn_) : fn(fn_) {
+			gz = gzopen(fn,"rb");
+			if(gz) gzbuffer(gz,1U << 20);
+		}
+		~gz_input() { if(gz) gzclose(gz); }
+		bool is_open() const { return gz != 0; }
+
+		ssize_t read(char* buf, size_t len) override {
+			if(!gz) return -1;
+			/* note: gzread() takes an unsigned int */
+			if(len > (1U << 30)) len = (1U << 30);
+			int ret = gzread(gz,buf,(unsigned int)len);
+			if(ret < 0) {
+				int err;
+				fprintf(stderr,"gz_input: error decompressing file %s: %s\n",fn,gzerror(gz,&err));
+				return -1;
+			}
+			return ret;
+		}
+
+		uint64_t in_pos() const override {
+			if(!gz) return 0;
+			z_off_t ret = gzoffset(gz);
+			return ret < 0 ? 0 : (uint64_t)ret;
+		}
+};
+
+
+/* xz input using liblzma, with the multithreaded decoder if available */
+class xz_input : public zinput {
+	protected:
+		FILE* f;
+		const char* fn;
+		lzma_stream strm;
+		uint8_t* in_buf;
+		bool eof;
+		bool ok;
+		unsigned int threads;
+		static const size_t in_buf_size = 1U << 20;
+		static const size_t header_size = 12; // size of the xz stream header
+		/* if decoding started at a block (see seek_block()), the input is
+		 * limited to the blocks and the size of the output is known */
+		bool limited;
+		uint64_t in_left; // compressed data left to read
+		uint64_t out_left; // decompressed data left to return
+		uint64_t skip; // decompressed data to discard at the start
+		uint64_t pos; // position in the file (see in_pos())
+
+		bool init_decoder() {
+			lzma_ret ret;
+#if LZMA_VERSION >= 50040002U
+			/* multithreaded decoder: only uses multiple threads if the
+			 * file has multiple blocks with size information stored */
+			if(threads == 0) threads = lzma_cputhreads();
+			if(threads == 0) threads = 1;
+			lzma_mt mt = {};
+			mt.flags = LZMA_CONCATENATED;
+			mt.threads = threads;
+			mt.timeout = 0;
+			mt.memlimit_threading = lzma_physmem() / 4;
+			mt.memlimit_stop = UINT64_MAX;
+			ret = lzma_stream_decoder_mt(&strm,&mt);
+#else
+			ret = lzma_stream_decoder(&strm,UINT64_MAX,LZMA_CONCATENATED);
+#endif
+			if(ret != LZMA_OK) {
+				fprintf(stderr,"xz_input: error initializing decoder (%d)\n",(int)ret);
+				return false;
+			}
+			strm.next_in = in_buf;
+			strm.avail_in = 0;
+			return true;
+		}
+
+		ssize_t read_data(char* buf, size_t len) {
+			if(!ok) return -1;
+			if(limited) {
+				if(out_left == 0) return 0;
+				if(len > out_left) len = out_left;
+			}
+			strm.next_out = (uint8_t*)buf;
+			strm.avail_out = len;
+			while(strm.avail_out) {
+				if(strm.avail_in == 0 && !eof) {
+					size_t n = in_buf_size;
+					if(limited && n > in_left) n = in_left;
+					strm.next_in = in_buf;
+					strm.avail_in = fread(in_buf,1,n,f);
+					pos += strm.avail_in;
+					if(strm.avail_in < n) {
+						if(ferror(f) || limited) {
+							fprintf(stderr,"xz_input: error reading file %s\n",fn);
+							ok = false;
+							return -1;
+						}
+						eof = true;
+					}
+					if(limited) {
+						in_left -= n;
+						if(in_left == 0) eof = true;
+					}
+				}
+				/* note: if decoding only some blocks, the stream is not
+				 * finished (the index is not given to the decoder), but
+				 * the expected amount of data is returned before */
+				lzma_ret ret = lzma_code(&strm,(eof && !limited) ? LZMA_FINISH : LZMA_RUN);
+				if(ret == LZMA_STREAM_END) break;
+				if(ret != LZMA_OK) {
+					fprintf(stderr,"xz_input: error decompressing file %s (%d)\n",fn,(int)ret);
+					ok = false;
+					/* return any data decoded before the error, the
+					 * next call will return -1 */
+					if(strm.avail_out == len) return -1;
+					break;
+				}
+			}
+			if(limited) out_left -= len - strm.avail_out;
+			return len - strm.avail_out;
+		}
+
+	public:
+		xz_input(const char* fn_, unsigned int threads_) : fn(fn_), strm(LZMA_STREAM_INIT), threads(threads_) {
+			in_buf = 0;
+			eof = false;
+			ok = false;
+			limited = false;
+			in_left = 0;
+			out_left = 0;
+			skip = 0;
+			pos = 0;
+			f = fopen(fn,"rb");
+			if(!f) return;
+			in_buf = (uint8_t*)malloc(in_buf_size);
+			if(!in_buf) return;
+			ok = init_decoder();
+		}
+		~xz_input() {
+			lzma_end(&strm);
+			if(in_buf) free(in_buf);
+			if(f) fclose(f);
+		}
+		bool is_open() const { return ok; }
+
+		/* start decompressing at the block starting at block_offset in the
+		 * file (instead of at the beginning); this is only supported for
+		 * files with one stream; index_offset is the offset of the stream
+		 * index (i.e. the end of the last block), size is the amount of
+		 * decompressed data from the start of the block to the end, and the
+		 * first skip bytes of it are discarded; these can be obtained from
+		 * the stream index (see tx_index in txindex.h)
+		 * should be called before reading anything, returns false on error */
+		bool seek_block(uint64_t block_offset, uint64_t index_offset, uint64_t size, uint64_t skip_) {
+			if(!ok || block_offset < header_size || block_offset > index_offset) return false;
+			lzma_end(&strm); // note: this allows initializing strm again
+			ok = init_decoder();
+			if(!ok) return false;
+			/* the decoder gets the stream header, followed by the blocks */
+			if(fseeko(f,0,SEEK_SET) || fread(in_buf,1,header_size,f) != header_size ||
+					fseeko(f,(off_t)block_offset,SEEK_SET)) {
+				fprintf(stderr,"xz_input: error reading file %s\n",fn);
+				ok = false;
+				return false;
+			}
+			strm.next_in = in_buf;
+			strm.avail_in = header_size;
+			limited = true;
+			eof = (block_offset == index_offset);
+			in_left = index_offset - block_offset;
+			out_left = size;
+			skip = skip_;
+			pos = block_offset;
+			return true;
+		}
+
+		ssize_t read(char* buf, size_t len) override {
+			while(skip) {
+				ssize_t ret = read_data(buf,(len < skip) ? len : (size_t)skip);
+				if(ret <= 0) return ret;
+				skip -= ret;
+			}
+			return read_data(buf,len);
+		}
+
+		uint64_t in_pos() const override { return pos; }
+};
+
+
+inline zinput* zinput::open(const char* fn, ztype type, unsigned int threads) {
+	zinput* z = 0;
+	bool is_open = false;
+	switch(type) {
+		case gzip:
+			{
+				gz_input* gz = new gz_input(fn);
+				is_open = gz->is_open();
+				z = gz;
+			}
+			break;
+		case xz:
+			{
+				xz_input* x = new xz_input(fn,threads);
+				is_open = x->is_open();
+				z = x;
+			}
+			break;
+	}
+	if(!is_open) {
+		fprintf(stderr,"zinput::open(): error opening file: %s\n",fn);
+		delete z;
+		z = 0;
+	}
+	return z;
+}
+
+#endif /* _ZINPUT_H */
+